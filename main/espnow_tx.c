@@ -0,0 +1,208 @@
+#include "espnow_tx.h"
+
+#include <esp_log.h>
+#include <esp_now.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+
+static const char* TAG = "espnow";
+
+typedef struct {
+    // Is a packet waiting in this slot?
+    bool           used;
+    clock_packet_t packet;
+    size_t         len;
+    // Time the packet was built, in milliseconds.
+    int64_t        built;
+    // Time the packet was queued, in microseconds.
+    int64_t        queued_us;
+} tx_slot_t;
+
+typedef struct {
+    int     type;
+    int64_t queued_us;
+    // Time the packet was handed to the driver, in microseconds.
+    int64_t sent_us;
+} tx_inflight_t;
+
+// Names of the ESPNOW_TX_* types.
+char const* const espnow_tx_names[ESPNOW_TX_TYPES] = {"edge", "ping"};
+
+// Destination of all packets.
+static uint8_t tx_peer[ESP_NOW_ETH_ALEN];
+// Waiting packet per type; only used by the sending task.
+static tx_slot_t tx_slots[ESPNOW_TX_TYPES];
+// Packets with the driver, oldest first; the driver reports them in order.
+static tx_inflight_t tx_inflight[ESPNOW_TX_INFLIGHT];
+static size_t        tx_inflight_first = 0;
+static size_t        tx_inflight_count = 0;
+// Counters per type.
+static espnow_tx_stats_t tx_stats[ESPNOW_TX_TYPES];
+// Guards `tx_inflight*` and `tx_stats`, which the WiFi task updates.
+static portMUX_TYPE tx_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Counts a finished packet of `type`; must be called with `tx_mux` held.
+static void tx_account(int type, int64_t queued_us, bool ok) {
+    espnow_tx_stats_t* stats = &tx_stats[type];
+    if (!ok) {
+        stats->failed++;
+        return;
+    }
+    uint32_t latency = esp_timer_get_time() - queued_us;
+    stats->sent++;
+    stats->latency_total_us += latency;
+    if (latency > stats->latency_max_us) stats->latency_max_us = latency;
+}
+
+// Called by the WiFi task when the driver is done with a packet.
+static void espnow_tx_done(uint8_t const* mac_addr, esp_now_send_status_t status) {
+    portENTER_CRITICAL(&tx_mux);
+    // After a reset or a timeout, a late report may be counted for a newer packet; only the counters suffer.
+    if (tx_inflight_count) {
+        tx_inflight_t const* done = &tx_inflight[tx_inflight_first];
+        tx_account(done->type, done->queued_us, status == ESP_NOW_SEND_SUCCESS);
+        tx_inflight_first = (tx_inflight_first + 1) % ESPNOW_TX_INFLIGHT;
+        tx_inflight_count--;
+    }
+    portEXIT_CRITICAL(&tx_mux);
+}
+
+// Sends to `peer_addr` from now on; call after esp_now_init.
+esp_err_t espnow_tx_init(uint8_t const* peer_addr) {
+    memcpy(tx_peer, peer_addr, sizeof(tx_peer));
+    return esp_now_register_send_cb(espnow_tx_done);
+}
+
+// Brings the time fields of a packet built `age` milliseconds ago up to date.
+// Returns false for an edge too old to carry its delay; receivers would place it too late.
+static bool tx_age(int type, clock_packet_t* packet, size_t len, int64_t age) {
+    if (type == ESPNOW_TX_EDGE) {
+        // Receivers place the edge `delay` before they hear the packet.
+        int64_t delay = (packet->packet.flags & PACKET_DELAY_MASK) >> PACKET_DELAY_SHIFT;
+        delay += age;
+        if (delay > ANNOUNCE_DELAY_MAX) return false;
+        packet->packet.flags = (packet->packet.flags & ~PACKET_DELAY_MASK) | (uint32_t) delay << PACKET_DELAY_SHIFT;
+    }
+    if (len == sizeof(clock_packet_t)) {
+        packet->clock.time += age;
+    }
+    return true;
+}
+
+// Hands the packet in `slot` to the driver; false if there is no room.
+static bool tx_send(int type, tx_slot_t* slot, int64_t now) {
+    portENTER_CRITICAL(&tx_mux);
+    if (tx_inflight_count >= ESPNOW_TX_INFLIGHT) {
+        portEXIT_CRITICAL(&tx_mux);
+        return false;
+    }
+    // Listed before sending, since the report can come before esp_now_send returns.
+    size_t last = (tx_inflight_first + tx_inflight_count) % ESPNOW_TX_INFLIGHT;
+    tx_inflight[last] = (tx_inflight_t){.type = type, .queued_us = slot->queued_us, .sent_us = esp_timer_get_time()};
+    tx_inflight_count++;
+    portEXIT_CRITICAL(&tx_mux);
+
+    slot->used = false;
+    if (now > slot->built && !tx_age(type, &slot->packet, slot->len, now - slot->built)) {
+        // Stale; dropped like a packet replaced by a newer one.
+        portENTER_CRITICAL(&tx_mux);
+        tx_inflight_count--;
+        tx_stats[type].replaced++;
+        portEXIT_CRITICAL(&tx_mux);
+        return true;
+    }
+    esp_err_t ec = esp_now_send(tx_peer, (uint8_t const*) &slot->packet, slot->len);
+    if (ec) {
+        // No report will come for it.
+        portENTER_CRITICAL(&tx_mux);
+        tx_inflight_count--;
+        tx_account(type, slot->queued_us, false);
+        portEXIT_CRITICAL(&tx_mux);
+        ESP_LOGD(TAG, "Sending %s packet failed: %s", espnow_tx_names[type], esp_err_to_name(ec));
+    }
+    return true;
+}
+
+// Gives up on packets the driver never reported, so a lost report cannot stop all sending.
+static void tx_expire() {
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&tx_mux);
+    while (tx_inflight_count && now_us - tx_inflight[tx_inflight_first].sent_us > ESPNOW_TX_TIMEOUT * 1000) {
+        tx_inflight_t const* lost = &tx_inflight[tx_inflight_first];
+        tx_account(lost->type, lost->queued_us, false);
+        tx_inflight_first = (tx_inflight_first + 1) % ESPNOW_TX_INFLIGHT;
+        tx_inflight_count--;
+    }
+    portEXIT_CRITICAL(&tx_mux);
+}
+
+// Sends waiting packets while there is room; call regularly from the same task as espnow_tx_queue.
+void espnow_tx_pump(int64_t now) {
+    tx_expire();
+    for (int i = 0; i < ESPNOW_TX_TYPES; i++) {
+        if (tx_slots[i].used && !tx_send(i, &tx_slots[i], now)) return;
+    }
+}
+
+// Drops the waiting packet of `type`, if any.
+static void tx_replace(int type) {
+    if (!tx_slots[type].used) return;
+    tx_slots[type].used = false;
+    portENTER_CRITICAL(&tx_mux);
+    tx_stats[type].replaced++;
+    portEXIT_CRITICAL(&tx_mux);
+}
+
+// Queues `packet` of `len` bytes, built at `now`, as ESPNOW_TX_* `type`, and sends it if there is room.
+void espnow_tx_queue(int type, int64_t now, clock_packet_t const* packet, size_t len) {
+    portENTER_CRITICAL(&tx_mux);
+    tx_stats[type].queued++;
+    portEXIT_CRITICAL(&tx_mux);
+
+    if (type == ESPNOW_TX_PING && tx_slots[ESPNOW_TX_EDGE].used) {
+        // The edge carries everything a ping would.
+        portENTER_CRITICAL(&tx_mux);
+        tx_stats[type].replaced++;
+        portEXIT_CRITICAL(&tx_mux);
+        return;
+    }
+    tx_replace(type);
+    if (type == ESPNOW_TX_EDGE) tx_replace(ESPNOW_TX_PING);
+
+    tx_slot_t* slot = &tx_slots[type];
+    memcpy(&slot->packet, packet, len);
+    slot->len       = len;
+    slot->built     = now;
+    slot->queued_us = esp_timer_get_time();
+    slot->used      = true;
+    espnow_tx_pump(now);
+}
+
+// Forgets waiting and unfinished packets, for when the radio is switched off.
+void espnow_tx_reset() {
+    for (int i = 0; i < ESPNOW_TX_TYPES; i++) {
+        tx_replace(i);
+    }
+    portENTER_CRITICAL(&tx_mux);
+    tx_inflight_count = 0;
+    portEXIT_CRITICAL(&tx_mux);
+}
+
+// Copies the counters of ESPNOW_TX_* `type`.
+void espnow_tx_get_stats(int type, espnow_tx_stats_t* stats) {
+    portENTER_CRITICAL(&tx_mux);
+    *stats = tx_stats[type];
+    portEXIT_CRITICAL(&tx_mux);
+}
+
+// Logs the counters of all types.
+void espnow_tx_dump() {
+    for (int i = 0; i < ESPNOW_TX_TYPES; i++) {
+        espnow_tx_stats_t stats;
+        espnow_tx_get_stats(i, &stats);
+        uint32_t avg = stats.sent ? stats.latency_total_us / stats.sent : 0;
+        ESP_LOGI(TAG, "Send %-4s %6u queued %6u replaced %6u sent %6u failed, latency %5u us average %6u us max", espnow_tx_names[i],
+            stats.queued, stats.replaced, stats.sent, stats.failed, avg, stats.latency_max_us);
+    }
+}
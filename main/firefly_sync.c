@@ -0,0 +1,532 @@
+/*
+ * This example code is in the Public Domain (or CC0 licensed, at your option.)
+ * Unless required by applicable law or agreed to in writing, this
+ * software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied.
+ */
+
+#include "firefly_sync.h"
+
+#include <esp_log.h>
+#include <esp_system.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint8_t const packet_magic[12] = "SAO.Firefly";
+
+// Older badges read only the packet_t prefix, so the clock fields must follow it directly.
+_Static_assert(sizeof(clock_packet_t) == sizeof(packet_t) + sizeof(packet_clock_t), "Clock fields must follow the packet");
+
+// Initialise with random timings and an empty peer table.
+void sync_init(sync_t *sync, uint32_t randid) {
+    memset(sync, 0, sizeof(sync_t));
+    sync->randid = randid;
+
+    // Initial randomisation.
+    sync->led_on_duration  = esp_random() % (LED_ON_DURATION_MAX  - LED_ON_DURATION_MIN)  + LED_ON_DURATION_MIN;
+    sync->led_off_duration = esp_random() % (LED_OFF_DURATION_MAX - LED_OFF_DURATION_MIN) + LED_OFF_DURATION_MIN;
+
+    sync->lp_heard_time  = INT64_MIN / 2;
+    sync->lp_full_listen = LP_FULL_LISTEN_CYCLES;
+    for (size_t i = 0; i < ANNOUNCE_SUPPRESS; i++) {
+        sync->announce_heard[0][i] = INT64_MIN / 2;
+        sync->announce_heard[1][i] = INT64_MIN / 2;
+    }
+    for (size_t i = 0; i < ID_TABLE_LEN; i++) {
+        sync->id_time_table[i] = -ID_TIMEOUT;
+    }
+}
+
+// Start from a previously converged period instead of a random one.
+void sync_warm_start(sync_t *sync, int64_t led_on_duration, int64_t led_off_duration) {
+    if (led_on_duration < LED_ON_DURATION_MIN) led_on_duration = LED_ON_DURATION_MIN;
+    if (led_on_duration > LED_ON_DURATION_MAX) led_on_duration = LED_ON_DURATION_MAX;
+    if (led_off_duration < LED_OFF_DURATION_MIN) led_off_duration = LED_OFF_DURATION_MIN;
+    if (led_off_duration > LED_OFF_DURATION_MAX) led_off_duration = LED_OFF_DURATION_MAX;
+    sync->led_on_duration  = led_on_duration;
+    sync->led_off_duration = led_off_duration;
+}
+
+// Whether enough cycles in a row were in sync with the peers.
+bool sync_converged(sync_t const *sync) {
+    return sync->lp_sync_cycles >= LP_SYNC_CYCLES;
+}
+
+// Whether the period follows the peers once per cycle; otherwise it steps on every packet.
+// Low-power badges only hear their own group most cycles, and a consensus within each group
+// holds the groups apart, so they keep the per-packet steps.
+static bool period_per_cycle(sync_t const *sync) {
+    return sync->period_mode == PERIOD_MODE_CYCLE && !sync->low_power;
+}
+
+// Remember the period reported by a peer, keeping only its latest report.
+static void period_report(sync_t *sync, int64_t now, packet_t const *packet, bool in_phase) {
+    period_report_t *report = NULL;
+    for (size_t i = 0; i < sync->period_report_count; i++) {
+        if (sync->period_reports[i].randid == packet->randid) {
+            report = &sync->period_reports[i];
+            break;
+        }
+    }
+    if (report) {
+        in_phase |= report->in_phase;
+    } else if (sync->period_report_count < PERIOD_REPORTS) {
+        report = &sync->period_reports[sync->period_report_count++];
+    } else {
+        // Full; replace the oldest report, preferring ones from peers not blinking with us.
+        for (size_t i = 0; i < PERIOD_REPORTS; i++) {
+            period_report_t *other = &sync->period_reports[i];
+            if (!report || (report->in_phase && !other->in_phase)
+                || (report->in_phase == other->in_phase && other->time < report->time)) {
+                report = other;
+            }
+        }
+        if (report->in_phase && !in_phase) return;
+        if (report->in_phase) sync->period_in_phase_count--;
+        report->in_phase = false;
+    }
+    if (in_phase && !report->in_phase) sync->period_in_phase_count++;
+    report->in_phase       = in_phase;
+    report->randid         = packet->randid;
+    report->total_duration = packet->total_duration;
+    report->time           = now;
+}
+
+// Weighted median of the periods reported this cycle and our own; reports weigh more the later they came.
+// Only peers blinking with us count if there are any, so separate flashes keep separate periods
+// and drift into each other instead of locking at a fixed offset.
+static int64_t period_consensus(sync_t const *sync, int64_t now) {
+    uint32_t periods[PERIOD_REPORTS + 1];
+    uint32_t weights[PERIOD_REPORTS + 1];
+    size_t   count        = 0;
+    uint32_t total_weight = 0;
+    int64_t  len          = sync->led_on_duration + sync->led_off_duration;
+
+    // Sorted by period as they are inserted; there are only a few.
+    for (size_t i = 0; i <= sync->period_report_count; i++) {
+        uint32_t period, weight;
+        if (i == sync->period_report_count) {
+            period = sync->led_on_duration + sync->led_off_duration;
+            weight = PERIOD_WEIGHT_NEW;
+        } else if (sync->period_in_phase_count && !sync->period_reports[i].in_phase) {
+            continue;
+        } else {
+            int64_t age = now - sync->period_reports[i].time;
+            if (age > len) age = len;
+            period = sync->period_reports[i].total_duration;
+            weight = PERIOD_WEIGHT_NEW - (PERIOD_WEIGHT_NEW - PERIOD_WEIGHT_OLD) * age / len;
+        }
+        size_t pos = count++;
+        while (pos > 0 && periods[pos - 1] > period) {
+            periods[pos] = periods[pos - 1];
+            weights[pos] = weights[pos - 1];
+            pos--;
+        }
+        periods[pos]  = period;
+        weights[pos]  = weight;
+        total_weight += weight;
+    }
+
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += weights[i];
+        if (sum * 2 >= total_weight) return periods[i];
+    }
+    return periods[count - 1];
+}
+
+// Pick the timings for the next cycle, at the start of a blink.
+static void randomise_times(sync_t *sync, int64_t now) {
+    int64_t consensus = 0;
+    if (period_per_cycle(sync) && sync->period_report_count) {
+        // Decided before the on time changes, as the median includes our own period.
+        consensus = period_consensus(sync, now);
+    }
+
+    sync->led_on_duration +=
+            (int)(esp_random() % LED_ON_DURATION_DRIFT) - LED_ON_DURATION_DRIFT / 2;
+    if (sync->led_on_duration < LED_ON_DURATION_MIN_RNG)
+        sync->led_on_duration = LED_ON_DURATION_MIN_RNG;
+    if (sync->led_on_duration > LED_ON_DURATION_MAX)
+        sync->led_on_duration = LED_ON_DURATION_MAX;
+
+    if (consensus) {
+        // A smaller random step still lets separate flashes slide into each other.
+        sync->led_off_duration += (int) (esp_random() % PERIOD_DRIFT) - PERIOD_DRIFT / 2;
+        // Go half way towards the peers, in one bounded step.
+        int64_t step = (consensus - sync->led_on_duration - sync->led_off_duration) / 2;
+        if (step > PERIOD_MAX_STEP) step = PERIOD_MAX_STEP;
+        if (step < -PERIOD_MAX_STEP) step = -PERIOD_MAX_STEP;
+        sync->led_off_duration += step;
+    } else {
+        // Alone, or following every packet instead.
+        sync->led_off_duration += (int) (esp_random() % LED_OFF_DURATION_DRIFT) - LED_OFF_DURATION_DRIFT / 2;
+    }
+    if (sync->led_off_duration < LED_OFF_DURATION_MIN) sync->led_off_duration = LED_OFF_DURATION_MIN;
+    if (sync->led_off_duration > LED_OFF_DURATION_MAX) sync->led_off_duration = LED_OFF_DURATION_MAX;
+    sync->period_report_count   = 0;
+    sync->period_in_phase_count = 0;
+}
+
+// Index into announce_heard for an ON or OFF announcement.
+static size_t announce_kind(uint32_t flags) {
+    return (flags & PACKET_FLAG_LED_ON) ? 0 : 1;
+}
+
+// Announce the ON or OFF edge at `edge` after a random backoff.
+static void announce_schedule(sync_t *sync, int64_t now, uint32_t flags, int64_t edge) {
+    sync->announce_flags = flags;
+    sync->announce_edge  = edge;
+    sync->announce_time  = now;
+    if (sync->announce_mode == ANNOUNCE_MODE_BACKOFF) {
+        sync->announce_time += esp_random() % ANNOUNCE_BACKOFF;
+    }
+}
+
+// Enable or disable the swarm clock mode; we are our own reference until we hear a better one.
+void sync_set_clock_mode(sync_t *sync, int64_t now, bool enable) {
+    sync->clock_mode      = enable;
+    sync->clock_ref       = sync->randid;
+    sync->clock_seq       = 0;
+    sync->clock_ref_time  = now;
+    sync->clock_period    = sync->led_on_duration + sync->led_off_duration;
+    sync->clock_count     = 0;
+    sync->clock_next      = 0;
+    sync->clock_intercept = 0;
+    sync->clock_skew      = 0;
+    sync->clock_slot      = -1;
+}
+
+// Whether the blinks follow the swarm clock.
+bool sync_clock_valid(sync_t const *sync) {
+    return sync->clock_mode && (sync->clock_ref == sync->randid || sync->clock_count >= CLOCK_MIN_POINTS);
+}
+
+// The swarm time at local time `now`.
+int64_t sync_clock_now(sync_t const *sync, int64_t now) {
+    return now + (int64_t) (sync->clock_intercept + sync->clock_skew * (now - sync->clock_mean));
+}
+
+// Become the reference, carrying on from the current estimate so the blinks don't jump.
+static void clock_become_ref(sync_t *sync, int64_t now) {
+    sync->clock_intercept = sync_clock_now(sync, now) - now;
+    sync->clock_skew      = 0;
+    sync->clock_mean      = now;
+    sync->clock_ref       = sync->randid;
+    sync->clock_seq       = 0;
+    sync->clock_ref_time  = now;
+    sync->clock_count     = 0;
+    sync->clock_next      = 0;
+}
+
+// Least squares fit of the swarm time offset against local time.
+static void clock_fit(sync_t *sync) {
+    int64_t mean_local  = 0;
+    double  mean_offset = 0;
+    for (size_t i = 0; i < sync->clock_count; i++) {
+        mean_local  += sync->clock_local[i];
+        mean_offset += sync->clock_offset[i];
+    }
+    mean_local  /= (int64_t) sync->clock_count;
+    mean_offset /= sync->clock_count;
+
+    double num = 0, den = 0;
+    for (size_t i = 0; i < sync->clock_count; i++) {
+        double dx = sync->clock_local[i] - mean_local;
+        num += dx * (sync->clock_offset[i] - mean_offset);
+        den += dx * dx;
+    }
+    sync->clock_mean      = mean_local;
+    sync->clock_intercept = mean_offset;
+    sync->clock_skew      = den > 0 ? num / den : 0;
+}
+
+// Take the swarm time from a received packet.
+static void clock_recv(sync_t *sync, int64_t now, packet_clock_t const *clock) {
+    if (clock->ref > sync->clock_ref || clock->ref == sync->randid) {
+        // Following a worse reference, which will hear ours; or our own time coming back.
+        return;
+    } else if (clock->ref < sync->clock_ref) {
+        // A better reference; start over.
+        sync->clock_ref   = clock->ref;
+        sync->clock_count = 0;
+        sync->clock_next  = 0;
+    } else if ((int32_t) (clock->seq - sync->clock_seq) <= 0) {
+        // Already have this or a newer time of the reference, from another peer.
+        return;
+    }
+
+    int64_t offset = clock->time - now;
+    if (sync->clock_count >= CLOCK_MIN_POINTS && llabs(sync_clock_now(sync, now) - clock->time) > CLOCK_MAX_ERROR) {
+        // The reference restarted or jumped.
+        sync->clock_count = 0;
+        sync->clock_next  = 0;
+    }
+    sync->clock_local[sync->clock_next]  = now;
+    sync->clock_offset[sync->clock_next] = offset;
+    sync->clock_next                     = (sync->clock_next + 1) % CLOCK_POINTS;
+    if (sync->clock_count < CLOCK_POINTS) sync->clock_count++;
+    clock_fit(sync);
+
+    sync->clock_seq      = clock->seq;
+    sync->clock_ref_time = now;
+    sync->clock_period   = clock->period;
+    // Comes from the network; a zero period would divide by zero in clock_tick.
+    if (sync->clock_period < LED_ON_DURATION_MIN + LED_OFF_DURATION_MIN) sync->clock_period = LED_ON_DURATION_MIN + LED_OFF_DURATION_MIN;
+    if (sync->clock_period > LED_ON_DURATION_MAX + LED_OFF_DURATION_MAX) sync->clock_period = LED_ON_DURATION_MAX + LED_OFF_DURATION_MAX;
+}
+
+// Blink when the swarm time enters a new period; returns one of the SYNC_EDGE_* values.
+static int clock_tick(sync_t *sync, int64_t now) {
+    int64_t swarm = sync_clock_now(sync, now);
+    int64_t slot  = swarm / sync->clock_period;
+    int64_t phase = swarm - slot * sync->clock_period;
+    if (sync->led_state || slot == sync->clock_slot || phase >= sync->led_on_duration) {
+        return SYNC_EDGE_NONE;
+    }
+
+    // Turn ON LED; the period is the swarm's, so peers not using the clock follow it too.
+    sync->led_state        = true;
+    sync->last_blink_time  = now - phase;
+    sync->clock_slot       = slot;
+    sync->led_off_duration = sync->clock_period - sync->led_on_duration;
+    if (sync->led_off_duration < LED_OFF_DURATION_MIN) sync->led_off_duration = LED_OFF_DURATION_MIN;
+    if (sync->led_off_duration > LED_OFF_DURATION_MAX) sync->led_off_duration = LED_OFF_DURATION_MAX;
+    announce_schedule(sync, now, PACKET_FLAG_LED_ON, sync->last_blink_time);
+    return SYNC_EDGE_ON;
+}
+
+// Handle a received packet.
+// Returns false if the packet is not a valid firefly packet.
+bool sync_recv(sync_t *sync, int64_t now, uint8_t const *data, size_t data_len) {
+    if (data_len < sizeof(packet_t)) {
+        // Too short; ignore this packet (counted by rx_filter.c).
+        return false;
+    }
+    packet_t packet;
+    memcpy(&packet, data, sizeof(packet_t));
+    if (memcmp(packet.magic, packet_magic, sizeof(packet_magic))) {
+        // Invalid magic; ignore this packet (counted by rx_filter.c).
+        return false;
+    }
+
+    // Announcements may be sent a little after the edge; go by the edge itself.
+    int64_t delay = (packet.flags & PACKET_DELAY_MASK) >> PACKET_DELAY_SHIFT;
+    int64_t edge  = now - (delay <= ANNOUNCE_DELAY_MAX ? delay : 0);
+    if (packet.flags & (PACKET_FLAG_LED_ON | PACKET_FLAG_LED_OFF)) {
+        size_t kind = announce_kind(packet.flags);
+        sync->announce_heard[kind][sync->announce_heard_next[kind]] = edge;
+        sync->announce_heard_next[kind] = (sync->announce_heard_next[kind] + 1) % ANNOUNCE_SUPPRESS;
+    }
+
+    if (sync->clock_mode && data_len >= sizeof(clock_packet_t)) {
+        packet_clock_t clock;
+        memcpy(&clock, data + sizeof(packet_t), sizeof(clock));
+        clock_recv(sync, now, &clock);
+    }
+
+    uint32_t total_duration = sync->led_on_duration + sync->led_off_duration;
+    if (sync_clock_valid(sync)) {
+        // The period is the swarm's.
+    } else if (period_per_cycle(sync)) {
+        // Applied once per cycle by randomise_times.
+        bool in_phase = (packet.flags & PACKET_FLAG_LED_ON) && edge >= sync->last_blink_time - LP_WINDOW && edge <= sync->last_blink_time + LP_WINDOW;
+        period_report(sync, now, &packet, in_phase);
+    } else if (total_duration < packet.total_duration) {
+        // We're too fase; increase cycle time.
+        sync->led_off_duration += (int) (esp_random() % LED_ON_DURATION_DRIFT) - LED_ON_DURATION_DRIFT / 4;
+        if (sync->led_off_duration > LED_OFF_DURATION_MAX) sync->led_off_duration = LED_OFF_DURATION_MAX;
+    } else if (total_duration > packet.total_duration) {
+        // We're too slow; decrease cycle time.
+        sync->led_off_duration -= (int) (esp_random() % LED_ON_DURATION_DRIFT) - LED_ON_DURATION_DRIFT / 4;
+        if (sync->led_off_duration < LED_OFF_DURATION_MIN) sync->led_off_duration = LED_OFF_DURATION_MIN;
+    }
+
+    bool has_update = false;
+    for (size_t i = 0; i < ID_TABLE_LEN; i++) {
+        if (sync->id_table[i] == packet.randid) {
+            ESP_LOGD("espnow", "Update i=%zu randid=%u", i, packet.randid);
+            sync->id_time_table[i] = now;
+            has_update = true;
+            break;
+        }
+    }
+    if (!has_update) {
+        for (size_t i = 0; i < ID_TABLE_LEN; i++) {
+            if (now > sync->id_time_table[i] + ID_TIMEOUT) {
+                ESP_LOGD("espnow", "Replace i=%zu randid=%u", i, packet.randid);
+                sync->id_table[i] = packet.randid;
+                sync->id_time_table[i] = now;
+                break;
+            }
+        }
+    }
+
+    if (packet.flags & PACKET_FLAG_LED_ON) {
+        // LED turned on.
+        ESP_LOGD("espnow", "Recv ON  packet");
+        int64_t last_blink_time = sync->last_blink_time;
+        // In sync if the peer turned ON close to our last or our next blink, judged before
+        // jumping: the jump always lands close to the packet that caused it.
+        int64_t next_blink_time = last_blink_time + sync->led_on_duration + sync->led_off_duration;
+        bool    in_sync         = llabs(edge - last_blink_time) <= LP_WINDOW || llabs(edge - next_blink_time) <= LP_WINDOW;
+        if (sync_clock_valid(sync)) {
+            // Blinks follow the swarm clock instead.
+        } else if (edge - last_blink_time < sync->led_on_duration + LED_OFF_DURATION_MIN) {
+            // Cannot blink right now.
+        } else if (!sync->led_state && edge > last_blink_time + sync->led_on_duration + LED_OFF_DURATION_MIN) {
+            // Acceptable timing; turns ON.
+            sync->last_blink_time = edge + (int) (esp_random() % (LED_SYNC_ERROR_MAX - LED_SYNC_ERROR_MIN)) + LED_SYNC_ERROR_MIN;
+        }
+        if (in_sync) {
+            // Heard a peer close to our own blink.
+            sync->lp_heard_time = edge;
+        }
+    }
+
+    return true;
+}
+
+// Advance the blink state machine; returns one of the SYNC_EDGE_* values.
+int sync_tick(sync_t *sync, int64_t now) {
+    int64_t last_blink_time  = sync->last_blink_time;
+    int64_t led_on_duration  = sync->led_on_duration;
+    int64_t led_off_duration = sync->led_off_duration;
+
+    if (sync->clock_mode && sync->clock_ref != sync->randid && now > sync->clock_ref_time + CLOCK_REF_TIMEOUT) {
+        // The reference is gone.
+        clock_become_ref(sync, now);
+    }
+
+    if (now > last_blink_time + led_on_duration && sync->led_state) {
+        // Turn OFF LED.
+        sync->led_state = false;
+
+        // Every peer ON of this cycle has arrived by now; were we in sync?
+        if (sync->lp_heard_time >= last_blink_time - LP_WINDOW && sync->lp_heard_time <= last_blink_time + LP_WINDOW) {
+            sync->lp_sync_cycles++;
+        } else {
+            sync->lp_sync_cycles = 0;
+        }
+        if (sync->lp_full_listen == 0) {
+            sync->lp_full_listen = LP_FULL_LISTEN_CYCLES;
+        } else {
+            sync->lp_full_listen--;
+        }
+        announce_schedule(sync, now, PACKET_FLAG_LED_OFF, now);
+        return SYNC_EDGE_OFF;
+
+    } else if (sync_clock_valid(sync)) {
+        return clock_tick(sync, now);
+
+    } else if (now >= last_blink_time && (now < last_blink_time + led_on_duration || now > last_blink_time + led_on_duration + led_off_duration) && !sync->led_state) {
+        // Turn ON LED.
+        sync->led_state = true;
+        sync->last_blink_time = now;
+        randomise_times(sync, now);
+        announce_schedule(sync, now, PACKET_FLAG_LED_ON, now);
+        return SYNC_EDGE_ON;
+    }
+
+    return SYNC_EDGE_NONE;
+}
+
+// The PACKET_FLAG_* flags, with the delay, of an ON or OFF announcement due at `now`; 0 if there is none.
+uint32_t sync_announce(sync_t *sync, int64_t now) {
+    if (!sync->announce_flags || now < sync->announce_time) return 0;
+    uint32_t flags = sync->announce_flags;
+    sync->announce_flags = 0;
+
+    if (sync->announce_mode == ANNOUNCE_MODE_BACKOFF) {
+        // Peers already told the swarm about this edge.
+        int64_t const *heard    = sync->announce_heard[announce_kind(flags)];
+        size_t         matching = 0;
+        for (size_t i = 0; i < ANNOUNCE_SUPPRESS; i++) {
+            if (llabs(heard[i] - sync->announce_edge) <= LP_WINDOW) matching++;
+        }
+        if (matching >= ANNOUNCE_SUPPRESS) {
+            sync->announce_suppressed++;
+            return 0;
+        }
+    }
+
+    int64_t delay = now - sync->announce_edge;
+    if (delay > ANNOUNCE_DELAY_MAX) delay = ANNOUNCE_DELAY_MAX;
+    sync->announce_sent++;
+    return flags | (uint32_t) delay << PACKET_DELAY_SHIFT;
+}
+
+// Build a packet to send, with PACKET_FLAG_* `flags`.
+void sync_make_packet(sync_t const *sync, packet_t *packet, uint32_t flags) {
+    memcpy(packet->magic, packet_magic, sizeof(packet_magic));
+    packet->flags = flags;
+    packet->total_duration = sync->led_on_duration + sync->led_off_duration;
+    packet->randid = sync->randid;
+}
+
+// Build a packet to send at `now`, with the swarm clock fields if they are known.
+// Returns the number of bytes to send.
+size_t sync_make_clock_packet(sync_t *sync, int64_t now, clock_packet_t *packet, uint32_t flags) {
+    sync_make_packet(sync, &packet->packet, flags);
+    if (!sync_clock_valid(sync)) return sizeof(packet_t);
+
+    if (sync->clock_ref == sync->randid) sync->clock_seq++;
+    packet->clock.time   = sync_clock_now(sync, now);
+    packet->clock.ref    = sync->clock_ref;
+    packet->clock.seq    = sync->clock_seq;
+    packet->clock.period = sync->clock_period;
+    return sizeof(clock_packet_t);
+}
+
+// Count the peers heard from recently.
+size_t sync_count_peers(sync_t const *sync, int64_t now) {
+    size_t on = 0;
+    for (size_t i = 0; i < ID_TABLE_LEN; i++) {
+        if (sync->id_time_table[i] + ID_TIMEOUT > now) {
+            on++;
+        }
+    }
+    return on;
+}
+
+// Whether the radio needs to be on at `now`.
+// Always true unless the low-power mode is enabled and we are in sync.
+bool sync_radio_needed(sync_t const *sync, int64_t now) {
+    if (!sync->low_power || !sync_converged(sync) || sync->lp_full_listen == 0 || sync->announce_flags) {
+        return true;
+    }
+
+    // Listen around our ON, our OFF and the next expected ON.
+    int64_t edges[] = {
+        sync->last_blink_time,
+        sync->last_blink_time + sync->led_on_duration,
+        sync->last_blink_time + sync->led_on_duration + sync->led_off_duration,
+    };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        if (now >= edges[i] - LP_WINDOW && now <= edges[i] + LP_WINDOW) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The next time at which the radio or the LED needs attention.
+int64_t sync_next_wake(sync_t const *sync, int64_t now) {
+    if (sync_radio_needed(sync, now)) {
+        return now;
+    }
+
+    int64_t edges[] = {
+        sync->last_blink_time,
+        sync->last_blink_time + sync->led_on_duration,
+        sync->last_blink_time + sync->led_on_duration + sync->led_off_duration,
+    };
+    int64_t wake = now;
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        int64_t start = edges[i] - LP_WINDOW;
+        if (start > now && (wake == now || start < wake)) {
+            wake = start;
+        }
+    }
+    return wake;
+}
@@ -0,0 +1,53 @@
+#include "i2c_eeprom.h"
+
+#include "i2c_sched.h"
+
+typedef struct {
+    EEPROM*  eeprom;
+    uint16_t address;
+    uint8_t* buffer;
+    size_t   length;
+} eeprom_job_t;
+
+static esp_err_t eeprom_read_job(void* arg) {
+    eeprom_job_t* job = arg;
+    return eeprom_read(job->eeprom, job->address, job->buffer, job->length);
+}
+
+static esp_err_t eeprom_write_job(void* arg) {
+    eeprom_job_t* job = arg;
+    return eeprom_write(job->eeprom, job->address, job->buffer, job->length);
+}
+
+// Runs `fn` on every page touched by `length` bytes at `address`.
+static esp_err_t eeprom_by_page(EEPROM* eeprom, uint16_t address, uint8_t* buffer, size_t length, i2c_job_fn_t fn) {
+    size_t page = eeprom->page_size;
+    while (length) {
+        // Up to the end of the page.
+        size_t chunk = page ? page - address % page : length;
+        if (chunk > length) chunk = length;
+
+        eeprom_job_t job = {
+            .eeprom  = eeprom,
+            .address = address,
+            .buffer  = buffer,
+            .length  = chunk,
+        };
+        esp_err_t ec = i2c_sched_run(I2C_PRIO_SAO, fn, &job);
+        if (ec) return ec;
+        address += chunk;
+        buffer  += chunk;
+        length  -= chunk;
+    }
+    return ESP_OK;
+}
+
+// Reads `length` bytes at `address`, one page at a time.
+esp_err_t i2c_eeprom_read(EEPROM* eeprom, uint16_t address, uint8_t* buffer, size_t length) {
+    return eeprom_by_page(eeprom, address, buffer, length, eeprom_read_job);
+}
+
+// Writes `length` bytes at `address`, one page at a time.
+esp_err_t i2c_eeprom_write(EEPROM* eeprom, uint16_t address, uint8_t* buffer, size_t length) {
+    return eeprom_by_page(eeprom, address, buffer, length, eeprom_write_job);
+}
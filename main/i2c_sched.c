@@ -0,0 +1,155 @@
+#include "i2c_sched.h"
+
+#include "mem_stats.h"
+#include "sleep_lock.h"
+#include "task_core.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+static const char* TAG = "i2c";
+
+// Stack size of the scheduler task.
+#define I2C_SCHED_TASK_STACK 3072
+// Above the render and glow tasks, so an LED edge is not held up by drawing.
+#define I2C_SCHED_TASK_PRIORITY 3
+
+typedef struct {
+    i2c_job_fn_t fn;
+    void*        arg;
+    // Time the job was queued, in microseconds.
+    int64_t      queued_us;
+    // Task waiting for the result; NULL if nobody waits.
+    TaskHandle_t waiter;
+    esp_err_t*   result;
+} i2c_job_t;
+
+// Names of the I2C_PRIO_* classes.
+char const* const i2c_prio_names[I2C_PRIOS] = {"LED", "RP2040", "SAO"};
+
+// Waiting jobs per priority class.
+static QueueHandle_t i2c_queues[I2C_PRIOS];
+// The task running the jobs.
+static TaskHandle_t i2c_task_handle;
+// Counters per priority class.
+static i2c_sched_stats_t i2c_stats[I2C_PRIOS];
+// Guards `i2c_stats`, which other tasks read.
+static portMUX_TYPE i2c_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Takes the next job, highest priority class first.
+static bool i2c_next_job(i2c_job_t* job, int* prio) {
+    for (int i = 0; i < I2C_PRIOS; i++) {
+        if (xQueueReceive(i2c_queues[i], job, 0)) {
+            *prio = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs queued jobs until all queues are empty.
+static void i2c_sched_task(void* arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        i2c_job_t job;
+        int       prio;
+        while (i2c_next_job(&job, &prio)) {
+            uint32_t wait = esp_timer_get_time() - job.queued_us;
+            portENTER_CRITICAL(&i2c_stats_mux);
+            i2c_stats[prio].jobs++;
+            i2c_stats[prio].wait_total_us += wait;
+            if (wait > i2c_stats[prio].wait_max_us) i2c_stats[prio].wait_max_us = wait;
+            portEXIT_CRITICAL(&i2c_stats_mux);
+
+            esp_err_t ec = job.fn(job.arg);
+            if (job.waiter) {
+                *job.result = ec;
+                xTaskNotifyGive(job.waiter);
+            } else if (ec) {
+                ESP_LOGD(TAG, "%s job failed: %s", i2c_prio_names[prio], esp_err_to_name(ec));
+            }
+            sleep_lock_release();
+        }
+    }
+}
+
+// Starts the scheduler task; until then, jobs run right away in the caller.
+esp_err_t i2c_sched_init() {
+    for (int i = 0; i < I2C_PRIOS; i++) {
+        i2c_queues[i] = xQueueCreate(I2C_SCHED_QUEUE_LEN, sizeof(i2c_job_t));
+        if (!i2c_queues[i]) return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(i2c_sched_task, "i2c", I2C_SCHED_TASK_STACK, NULL, I2C_SCHED_TASK_PRIORITY, &i2c_task_handle, HELPER_TASK_CORE) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    mem_stats_add_task("i2c", i2c_task_handle, I2C_SCHED_TASK_STACK);
+    return ESP_OK;
+}
+
+// Queues `job` in priority class `prio`, waiting at most `timeout` for room.
+static esp_err_t i2c_queue(int prio, i2c_job_t const* job, TickType_t timeout) {
+    // Held until the job has run, so light sleep cannot cut a transaction short.
+    sleep_lock_acquire();
+    if (!xQueueSend(i2c_queues[prio], job, timeout)) {
+        sleep_lock_release();
+        portENTER_CRITICAL(&i2c_stats_mux);
+        i2c_stats[prio].dropped++;
+        portEXIT_CRITICAL(&i2c_stats_mux);
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskNotifyGive(i2c_task_handle);
+    return ESP_OK;
+}
+
+// Runs `fn` in priority class `prio` and returns its result.
+// Waits with the caller's task notification; not for use from a job.
+esp_err_t i2c_sched_run(int prio, i2c_job_fn_t fn, void* arg) {
+    if (!i2c_task_handle) return fn(arg);
+
+    esp_err_t result = ESP_FAIL;
+    i2c_job_t job    = {
+        .fn        = fn,
+        .arg       = arg,
+        .queued_us = esp_timer_get_time(),
+        .waiter    = xTaskGetCurrentTaskHandle(),
+        .result    = &result,
+    };
+    i2c_queue(prio, &job, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return result;
+}
+
+// Queues `fn` in priority class `prio` without waiting for it; ESP_ERR_NO_MEM if the queue is full.
+esp_err_t i2c_sched_post(int prio, i2c_job_fn_t fn, void* arg) {
+    if (!i2c_task_handle) return fn(arg);
+
+    i2c_job_t job = {
+        .fn        = fn,
+        .arg       = arg,
+        .queued_us = esp_timer_get_time(),
+    };
+    return i2c_queue(prio, &job, 0);
+}
+
+// Copies the counters of priority class `prio`.
+void i2c_sched_get_stats(int prio, i2c_sched_stats_t* stats) {
+    portENTER_CRITICAL(&i2c_stats_mux);
+    *stats = i2c_stats[prio];
+    portEXIT_CRITICAL(&i2c_stats_mux);
+}
+
+// Logs the counters of all priority classes.
+void i2c_sched_dump() {
+    for (int i = 0; i < I2C_PRIOS; i++) {
+        i2c_sched_stats_t stats;
+        i2c_sched_get_stats(i, &stats);
+        uint32_t        avg   = stats.jobs ? stats.wait_total_us / stats.jobs : 0;
+        esp_log_level_t level = stats.dropped ? ESP_LOG_WARN : ESP_LOG_INFO;
+        ESP_LOG_LEVEL(level, TAG, "%-6s %7u jobs, wait %5u us average %6u us max, %u dropped", i2c_prio_names[i],
+            stats.jobs, avg, stats.wait_max_us, stats.dropped);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <esp_system.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "firefly_sync.h"
+
+// Send pipeline for the firefly packets.
+// Every packet type has one waiting slot: a newer packet replaces the waiting one, and a
+// waiting edge makes a ping redundant. At most ESPNOW_TX_INFLIGHT packets are with the
+// driver at a time; the rest waits until the send callback reports one done.
+
+// Packet types, in the order they are sent.
+// ON and OFF announcements.
+#define ESPNOW_TX_EDGE  0
+// Periodic pings.
+#define ESPNOW_TX_PING  1
+// Number of ESPNOW_TX_* types.
+#define ESPNOW_TX_TYPES 2
+
+// Packets handed to the driver and not reported done yet.
+#define ESPNOW_TX_INFLIGHT 2
+// A packet without a send report after this many milliseconds counts as failed and frees its place.
+#define ESPNOW_TX_TIMEOUT 100
+
+typedef struct {
+    // Packets handed to the pipeline.
+    uint32_t queued;
+    // Packets dropped for a newer or more useful one, or because they waited too long.
+    uint32_t replaced;
+    // Packets the driver reported sent.
+    uint32_t sent;
+    // Packets the driver refused, reported failed or never reported.
+    uint32_t failed;
+    // Time from queueing to the send report, in microseconds.
+    uint64_t latency_total_us;
+    uint32_t latency_max_us;
+} espnow_tx_stats_t;
+
+// Names of the ESPNOW_TX_* types.
+extern char const* const espnow_tx_names[ESPNOW_TX_TYPES];
+
+// Sends to `peer_addr` from now on; call after esp_now_init.
+esp_err_t espnow_tx_init(uint8_t const* peer_addr);
+// Queues `packet` of `len` bytes, built at `now`, as ESPNOW_TX_* `type`, and sends it if there is room.
+void espnow_tx_queue(int type, int64_t now, clock_packet_t const* packet, size_t len);
+// Sends waiting packets while there is room; call regularly from the same task as espnow_tx_queue.
+void espnow_tx_pump(int64_t now);
+// Forgets waiting and unfinished packets, for when the radio is switched off.
+void espnow_tx_reset();
+// Copies the counters of ESPNOW_TX_* `type`.
+void espnow_tx_get_stats(int type, espnow_tx_stats_t* stats);
+// Logs the counters of all types.
+void espnow_tx_dump();
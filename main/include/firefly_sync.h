@@ -0,0 +1,257 @@
+/*
+ * This example code is in the Public Domain (or CC0 licensed, at your option.)
+ * Unless required by applicable law or agreed to in writing, this
+ * software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied.
+ */
+
+// Firefly synchronisation logic.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimum LED on time (for cycle).
+#define LED_ON_DURATION_MIN_RNG 1000
+// Minimum LED on time (for sync).
+#define LED_ON_DURATION_MIN 1000
+// Maximum LED on time.
+#define LED_ON_DURATION_MAX 1250
+// Maximum LED on time drift.
+#define LED_ON_DURATION_DRIFT 50
+
+// Minimum LED off time (for cycle).
+#define LED_OFF_DURATION_MIN_RNG 3000
+// Minimum LED off time (for sync).
+#define LED_OFF_DURATION_MIN 1500
+// Maximum LED off time.
+#define LED_OFF_DURATION_MAX 5000
+// Maximum LED off time drift.
+#define LED_OFF_DURATION_DRIFT 100
+
+// Synchronisation error time.
+#define LED_SYNC_ERROR_MIN 100
+// Synchronisation error time.
+#define LED_SYNC_ERROR_MAX 250
+
+// Pinging interval in milliseconds.
+#define PING_INTERVAL 1000
+// Amount of IDs to keep track of at most.
+#define ID_TABLE_LEN 1337
+// Maximum age of IDs in milliseconds.
+#define ID_TIMEOUT 6000
+// LEDs turning ON flag.
+#define PACKET_FLAG_LED_ON 0x00000001
+// LEDs turning OFF flag.
+#define PACKET_FLAG_LED_OFF 0x00000002
+// Firefly detected flag.
+#define PACKET_FLAG_SAO 0x00000004
+// Milliseconds between the ON or OFF edge and sending its packet, in the top flag bits.
+// Older badges only test the bits above, so they ignore it.
+#define PACKET_DELAY_SHIFT 16
+#define PACKET_DELAY_MASK  0xffff0000
+
+// Half width of a low-power listen window around an expected edge in milliseconds.
+#define LP_WINDOW 300
+// Consecutive cycles with a peer ON inside our window before the radio is duty-cycled.
+#define LP_SYNC_CYCLES 3
+// Every this many cycles, the radio stays on for a whole cycle to find new neighbours.
+#define LP_FULL_LISTEN_CYCLES 10
+// Don't bother light-sleeping for less than this many milliseconds.
+#define LP_MIN_SLEEP 30
+
+// Peers whose period is remembered per cycle.
+#define PERIOD_REPORTS 64
+// Weight of a period report from the start of the cycle.
+#define PERIOD_WEIGHT_OLD 1
+// Weight of a period report from the end of the cycle.
+#define PERIOD_WEIGHT_NEW 4
+// Largest period correction per cycle in milliseconds.
+#define PERIOD_MAX_STEP 100
+// Random LED off time drift per cycle while following the peers.
+#define PERIOD_DRIFT (LED_OFF_DURATION_DRIFT / 2)
+
+// Adjust the period once per cycle towards the weighted median of the peers.
+// Low-power mode steps per packet instead.
+#define PERIOD_MODE_CYCLE  0
+// Adjust the period by a random step for every packet with a different period.
+#define PERIOD_MODE_PACKET 1
+
+// Longest random delay before announcing an ON or OFF edge in milliseconds.
+// Spreads the announcements of a synchronised swarm so fewer of them collide.
+#define ANNOUNCE_BACKOFF 40
+// Skip our own announcement after hearing this many peers announce the same edge.
+// Low-power swarms of 50 and 100 badges hold together as well with it as without.
+#define ANNOUNCE_SUPPRESS 6
+// Delays above this are not trusted, in milliseconds.
+#define ANNOUNCE_DELAY_MAX LP_WINDOW
+
+// Announce edges after a random backoff, carrying the delay, unless enough peers did already.
+#define ANNOUNCE_MODE_BACKOFF   0
+// Announce every edge right away, like older badges.
+#define ANNOUNCE_MODE_IMMEDIATE 1
+
+// In the swarm clock mode, every packet carries the sender's estimate of the time of a
+// reference badge, the one with the lowest randid. Badges fit offset and drift against the
+// reference from the last few samples (like FTSP), pass on their estimate, and blink when the
+// swarm time passes a multiple of the swarm period instead of following ON packets.
+
+// Swarm clock samples kept for the offset and drift estimate.
+#define CLOCK_POINTS 8
+// Samples needed before blinking on the swarm clock.
+#define CLOCK_MIN_POINTS 3
+// Elect a new reference after not hearing its time for this many milliseconds.
+#define CLOCK_REF_TIMEOUT 10000
+// A sample this far off the estimate in milliseconds restarts the estimate.
+#define CLOCK_MAX_ERROR 100
+
+// Nothing happened.
+#define SYNC_EDGE_NONE 0
+// The LED turned ON.
+#define SYNC_EDGE_ON   1
+// The LED turned OFF.
+#define SYNC_EDGE_OFF  2
+
+extern uint8_t const packet_magic[12];
+typedef struct {
+    uint8_t magic[sizeof(packet_magic)];
+    uint32_t flags;
+    uint32_t total_duration;
+    uint32_t randid;
+} packet_t;
+
+// Swarm clock fields, appended to packet_t by badges in the swarm clock mode.
+// Older badges only look at the packet_t part.
+typedef struct __attribute__((packed)) {
+    // Swarm time when sent, in milliseconds.
+    int64_t  time;
+    // Randid of the reference badge whose clock the swarm time follows.
+    uint32_t ref;
+    // Sequence number of the newest reference time the sender has taken.
+    uint32_t seq;
+    // Blink period of the swarm in milliseconds.
+    uint32_t period;
+} packet_clock_t;
+
+// The clock fields are packed, so they follow the packet without padding.
+typedef struct {
+    packet_t       packet;
+    packet_clock_t clock;
+} clock_packet_t;
+
+typedef struct {
+    // Sender of the report.
+    uint32_t randid;
+    // Period the sender reported.
+    uint32_t total_duration;
+    // Time of the report.
+    int64_t  time;
+    // Whether the sender turned ON close to our own blink.
+    bool     in_phase;
+} period_report_t;
+
+typedef struct {
+    // Current LED state.
+    bool led_state;
+    // Current LED on time setting.
+    int64_t led_on_duration;
+    // Current LED off time setting.
+    int64_t led_off_duration;
+    // Start of the last blink time.
+    int64_t last_blink_time;
+    // Random ID decided at startup.
+    uint32_t randid;
+
+    // How the period follows the peers; one of the PERIOD_MODE_* values.
+    int period_mode;
+    // Latest period of each peer heard this cycle.
+    period_report_t period_reports[PERIOD_REPORTS];
+    // Number of valid period reports.
+    size_t period_report_count;
+    // Number of those from peers blinking with us.
+    size_t period_in_phase_count;
+
+    // How ON and OFF edges are announced; one of the ANNOUNCE_MODE_* values.
+    int announce_mode;
+    // PACKET_FLAG_LED_ON or PACKET_FLAG_LED_OFF of the edge to announce; 0 if none.
+    uint32_t announce_flags;
+    // Time of the edge to announce.
+    int64_t announce_edge;
+    // Time to send the announcement.
+    int64_t announce_time;
+    // Edge times of the last ON and OFF announcements heard, in rings.
+    int64_t announce_heard[2][ANNOUNCE_SUPPRESS];
+    size_t announce_heard_next[2];
+    // Announcements sent and skipped since the start.
+    uint32_t announce_sent, announce_suppressed;
+
+    // Is the swarm clock mode enabled?
+    bool clock_mode;
+    // Randid of the reference; our own if we are the reference.
+    uint32_t clock_ref;
+    // Newest sequence number taken from the reference, or sent if we are the reference.
+    uint32_t clock_seq;
+    // Last time a new reference time was heard.
+    int64_t clock_ref_time;
+    // Blink period of the swarm.
+    uint32_t clock_period;
+    // Samples of local time and swarm time minus local time, in a ring.
+    int64_t clock_local[CLOCK_POINTS];
+    int64_t clock_offset[CLOCK_POINTS];
+    // Number of samples and next one to replace.
+    size_t clock_count, clock_next;
+    // Linear fit of the samples: offset at clock_mean plus clock_skew per millisecond after it.
+    int64_t clock_mean;
+    double clock_intercept, clock_skew;
+    // Swarm period number of the last blink.
+    int64_t clock_slot;
+
+    // Is the low-power mode enabled?
+    bool low_power;
+    // Last time a peer ON was heard inside our window.
+    int64_t lp_heard_time;
+    // Consecutive cycles in sync.
+    int lp_sync_cycles;
+    // Cycles until the next full listen round.
+    int lp_full_listen;
+
+    // Randid buffer.
+    uint32_t id_table[ID_TABLE_LEN];
+    // Randid recv timestamp.
+    int64_t id_time_table[ID_TABLE_LEN];
+} sync_t;
+
+// Initialise with random timings and an empty peer table.
+void sync_init(sync_t *sync, uint32_t randid);
+// Start from a previously converged period instead of a random one.
+void sync_warm_start(sync_t *sync, int64_t led_on_duration, int64_t led_off_duration);
+// Whether enough cycles in a row were in sync with the peers.
+bool sync_converged(sync_t const *sync);
+// Handle a received packet.
+// Returns false if the packet is not a valid firefly packet.
+bool sync_recv(sync_t *sync, int64_t now, uint8_t const *data, size_t data_len);
+// Advance the blink state machine; returns one of the SYNC_EDGE_* values.
+int sync_tick(sync_t *sync, int64_t now);
+// The PACKET_FLAG_* flags, with the delay, of an ON or OFF announcement due at `now`; 0 if there is none.
+uint32_t sync_announce(sync_t *sync, int64_t now);
+// Build a packet to send, with PACKET_FLAG_* `flags`.
+void sync_make_packet(sync_t const *sync, packet_t *packet, uint32_t flags);
+// Build a packet to send at `now`, with the swarm clock fields if they are known.
+// Returns the number of bytes to send.
+size_t sync_make_clock_packet(sync_t *sync, int64_t now, clock_packet_t *packet, uint32_t flags);
+// Enable or disable the swarm clock mode; we are our own reference until we hear a better one.
+void sync_set_clock_mode(sync_t *sync, int64_t now, bool enable);
+// Whether the blinks follow the swarm clock.
+bool sync_clock_valid(sync_t const *sync);
+// The swarm time at local time `now`.
+int64_t sync_clock_now(sync_t const *sync, int64_t now);
+// Count the peers heard from recently.
+size_t sync_count_peers(sync_t const *sync, int64_t now);
+
+// Whether the radio needs to be on at `now`.
+// Always true unless the low-power mode is enabled and we are in sync.
+bool sync_radio_needed(sync_t const *sync, int64_t now);
+// The next time at which the radio or the LED needs attention.
+int64_t sync_next_wake(sync_t const *sync, int64_t now);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <esp_system.h>
+#include "eeprom.h"
+
+// SAO EEPROM access through the bus scheduler (i2c_sched.h).
+// Every page is a separate job in the I2C_PRIO_SAO class, so LED and RP2040 traffic
+// can go in between.
+
+// Reads `length` bytes at `address`, one page at a time.
+esp_err_t i2c_eeprom_read(EEPROM* eeprom, uint16_t address, uint8_t* buffer, size_t length);
+// Writes `length` bytes at `address`, one page at a time.
+esp_err_t i2c_eeprom_write(EEPROM* eeprom, uint16_t address, uint8_t* buffer, size_t length);
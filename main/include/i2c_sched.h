@@ -0,0 +1,51 @@
+#pragma once
+
+#include <esp_system.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Scheduler for I2C bus 0, shared by the RP2040 (firefly LED, buttons) and the SAO EEPROM.
+// One task runs the queued transactions, highest priority class first, and looks at the
+// queues again after every one. EEPROM access is split at page boundaries (see
+// i2c_eeprom.h), so a blink edge waits for at most one page instead of a whole scan.
+
+// Priority classes, highest first.
+// Switching the firefly LED.
+#define I2C_PRIO_LED    0
+// Other RP2040 traffic.
+#define I2C_PRIO_RP2040 1
+// SAO EEPROM probing and storage.
+#define I2C_PRIO_SAO    2
+// Number of I2C_PRIO_* classes.
+#define I2C_PRIOS       3
+
+// Jobs that can wait per priority class.
+#define I2C_SCHED_QUEUE_LEN 8
+
+// A bus transaction, run by the scheduler task.
+typedef esp_err_t (*i2c_job_fn_t)(void* arg);
+
+typedef struct {
+    // Jobs run.
+    uint32_t jobs;
+    // Jobs that did not fit in the queue.
+    uint32_t dropped;
+    // Time from queueing to start, in microseconds.
+    uint64_t wait_total_us;
+    uint32_t wait_max_us;
+} i2c_sched_stats_t;
+
+// Names of the I2C_PRIO_* classes.
+extern char const* const i2c_prio_names[I2C_PRIOS];
+
+// Starts the scheduler task; until then, jobs run right away in the caller.
+esp_err_t i2c_sched_init();
+// Runs `fn` in priority class `prio` and returns its result.
+// Waits with the caller's task notification; not for use from a job.
+esp_err_t i2c_sched_run(int prio, i2c_job_fn_t fn, void* arg);
+// Queues `fn` in priority class `prio` without waiting for it; ESP_ERR_NO_MEM if the queue is full.
+esp_err_t i2c_sched_post(int prio, i2c_job_fn_t fn, void* arg);
+// Copies the counters of priority class `prio`.
+void i2c_sched_get_stats(int prio, i2c_sched_stats_t* stats);
+// Logs the counters of all priority classes.
+void i2c_sched_dump();
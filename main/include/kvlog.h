@@ -0,0 +1,49 @@
+#pragma once
+
+#include "eeprom.h"
+
+// Small key-value log for persistent state in an EEPROM region.
+// Every commit appends a snapshot of all keys as 16-byte records after the
+// previous commit, wrapping around the region, so writes are spread over all
+// pages and overwriting the oldest records never loses a key. A commit never
+// straddles a page boundary and costs one page write when its records fit in
+// a page. Opening scans the region and keeps the newest valid record of each
+// key; torn writes fail their checksum and are ignored.
+
+// Number of keys.
+#define KVLOG_MAX_KEYS     8
+// Bytes of value per key.
+#define KVLOG_VALUE_SIZE   8
+// Size of one record.
+#define KVLOG_RECORD_SIZE  16
+// Largest region used, which bounds the scan time when opening.
+#define KVLOG_MAX_REGION   2048
+// Bytes read at a time while scanning.
+#define KVLOG_CHUNK        64
+
+typedef struct {
+    // EEPROM holding the log.
+    EEPROM   eeprom;
+    // Region in bytes; start is page aligned.
+    uint32_t start, size;
+    // Offset of the next record in the region.
+    uint32_t next;
+    // Sequence number of the last commit.
+    uint16_t seq;
+    // Current values.
+    uint8_t  values[KVLOG_MAX_KEYS][KVLOG_VALUE_SIZE];
+    // Keys with a value.
+    uint8_t  valid;
+    // Keys changed since the last commit.
+    uint8_t  dirty;
+} kvlog_t;
+
+// Opens the log in `size` bytes starting at `start` of `eeprom`.
+// The region is shrunk to whole pages and to at most KVLOG_MAX_REGION.
+esp_err_t kvlog_open(kvlog_t* log, EEPROM const* eeprom, uint32_t start, uint32_t size);
+// Reads `len` bytes of the value of `key`; returns false if it has no value.
+bool kvlog_get(kvlog_t const* log, uint8_t key, void* value, size_t len);
+// Changes the value of `key` in memory; stored by the next commit.
+void kvlog_set(kvlog_t* log, uint8_t key, void const* value, size_t len);
+// Appends all keys to the log if any of them changed.
+esp_err_t kvlog_commit(kvlog_t* log);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <esp_system.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sao_eeprom.h"
+
+// Number of LEDs on the badge itself, in GRB order.
+#define GLOW_BADGE_LEDS 5
+// Maximum number of neopixel SAO LEDs, chained after the badge's own.
+#define GLOW_MAX_SAO_LEDS 32
+// Number of brightness steps in a fade.
+#define GLOW_STEPS 32
+// Time between two fade frames in milliseconds.
+#define GLOW_FRAME_INTERVAL 10
+// Fade steps per frame when turning on (fast rise).
+#define GLOW_RISE_STEPS 4
+// Fade steps per frame when turning off (slow firefly-like decay).
+#define GLOW_FALL_STEPS 1
+
+// Starts the WS2812 glow output on the badge's LEDs.
+esp_err_t led_glow_init();
+// Also draws the glow on `sao_length` neopixel SAO LEDs in `sao_order`, after the badge's own; 0 for none.
+// Frames are only recomputed if the layout actually changed.
+void led_glow_set_layout(uint16_t sao_length, uint8_t sao_order);
+// Starts fading the glow in or out; does not block.
+void led_glow_set(bool on);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Memory accounting.
+// Subsystems register their fixed allocations (static tables and buffers
+// allocated once) and their tasks when they start. A snapshot adds the heap
+// per capability and the stack high-water mark of every registered task.
+// Registration happens from the main task only; the render task just reads.
+
+// Maximum number of registered fixed allocations.
+#define MEM_MAX_REGIONS 16
+// Maximum number of registered tasks.
+#define MEM_MAX_TASKS   12
+// Tasks with less stack than this ever left are flagged, in bytes.
+#define MEM_STACK_LOW   512
+
+// Heaps by capability.
+#define MEM_HEAP_INTERNAL 0
+#define MEM_HEAP_DMA      1
+#define MEM_HEAP_PSRAM    2
+// Number of MEM_HEAP_* values.
+#define MEM_HEAPS         3
+
+typedef struct {
+    char const* name;
+    size_t      size;
+} mem_region_t;
+
+typedef struct {
+    // Size in bytes; 0 if there is no such memory.
+    size_t total;
+    size_t free;
+    // Least free since boot.
+    size_t min_free;
+    // Largest free block; far below `free` means fragmentation.
+    size_t largest;
+} mem_heap_t;
+
+typedef struct {
+    char const* name;
+    // Stack size in bytes; 0 if not known.
+    size_t      stack_size;
+    // Least free stack since the task started, in bytes.
+    size_t      stack_free;
+} mem_task_t;
+
+typedef struct {
+    mem_heap_t   heaps[MEM_HEAPS];
+    mem_region_t regions[MEM_MAX_REGIONS];
+    size_t       region_count;
+    // Sum of all region sizes.
+    size_t       region_total;
+    mem_task_t   tasks[MEM_MAX_TASKS];
+    size_t       task_count;
+} mem_snapshot_t;
+
+// Names of the MEM_HEAP_* values.
+extern char const* const mem_heap_names[MEM_HEAPS];
+
+// Registers a fixed allocation of `size` bytes; `name` must stay valid.
+void mem_stats_add_region(char const* name, size_t size);
+// Registers a task with a stack of `stack_size` bytes, 0 if not known; `name` must stay valid.
+void mem_stats_add_task(char const* name, TaskHandle_t task, size_t stack_size);
+// Takes a snapshot of all memory use.
+void mem_stats_sample(mem_snapshot_t* snapshot);
+// Logs a snapshot to the console.
+void mem_stats_dump();
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Receive filter in front of the sync logic.
+// Drops malformed packets and rate-limits every sender, told apart by MAC
+// address and the randid in the packet, with a token bucket. One more bucket
+// limits the whole swarm and another the senders not seen before. The
+// buckets live in a small set-associative table, so every check costs the
+// same few comparisons no matter how many senders there are. Rejects are only
+// counted; rx_filter_summary reports them periodically.
+
+// Packets per second a single badge may send; it sends about 1.5.
+#define RX_SENDER_RATE     4
+// Packets a single badge may send in a burst.
+#define RX_SENDER_BURST    8
+// Packets per second the whole swarm may feed into the sync logic.
+#define RX_SWARM_RATE      1000
+// Packets the whole swarm may send in a burst.
+#define RX_SWARM_BURST     500
+// New senders per second the filter starts tracking.
+#define RX_NEW_RATE        10
+// New senders the filter starts tracking in a burst.
+#define RX_NEW_BURST       40
+// Number of sets in the bucket table.
+#define RX_FILTER_SETS     256
+// Number of buckets per set; the least recently used one is replaced.
+#define RX_FILTER_WAYS     4
+// Minimum interval between reject summaries in milliseconds.
+#define RX_SUMMARY_INTERVAL 10000
+
+// The packet may be given to the sync logic.
+#define RX_ACCEPT          0
+// Shorter than a packet_t.
+#define RX_REJECT_SHORT    1
+// Not a firefly packet.
+#define RX_REJECT_MAGIC    2
+// This sender sends too fast.
+#define RX_REJECT_SENDER   3
+// The swarm as a whole sends too fast, or too many new senders appear.
+#define RX_REJECT_SWARM    4
+// Number of RX_* verdicts.
+#define RX_VERDICTS        5
+
+typedef struct {
+    // Sender: MAC address and randid combined; 0 if unused.
+    uint64_t key;
+    // Time of the last refill in milliseconds.
+    uint32_t time;
+    // Available tokens in thousandths of a packet.
+    int32_t  credit;
+} rx_bucket_t;
+
+typedef struct {
+    // Packets per RX_* verdict since rx_filter_init.
+    uint32_t count[RX_VERDICTS];
+} rx_filter_stats_t;
+
+typedef struct {
+    // Per-sender buckets.
+    rx_bucket_t       buckets[RX_FILTER_SETS][RX_FILTER_WAYS];
+    // Bucket of the whole swarm.
+    rx_bucket_t       swarm;
+    // Bucket of senders not in the table yet.
+    rx_bucket_t       newcomers;
+    // Counters, written only by rx_filter_check.
+    rx_filter_stats_t stats;
+    // Counters at the last summary.
+    rx_filter_stats_t reported;
+    // Time of the last summary.
+    int64_t           report_time;
+} rx_filter_t;
+
+// Empties the filter.
+void rx_filter_init(rx_filter_t* filter, int64_t now);
+// Checks a packet from `mac` received at `now`; returns one of the RX_* verdicts.
+int rx_filter_check(rx_filter_t* filter, int64_t now, uint8_t const* mac, uint8_t const* data, size_t len);
+// At most once per RX_SUMMARY_INTERVAL, stores the counts since the previous summary in `delta`.
+// Returns true if any packets were rejected in that time.
+bool rx_filter_summary(rx_filter_t* filter, int64_t now, rx_filter_stats_t* delta);
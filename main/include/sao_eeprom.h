@@ -1,6 +1,7 @@
 #pragma once
 
 #include <esp_system.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef enum { SAO_NONE, SAO_UNFORMATTED, SAO_BINARY, SAO_JSON } sao_type_t;
@@ -149,6 +150,23 @@ typedef struct __attribute__((__packed__)) {
     uint8_t serial_no_hi; // Serial No. shown on package
 } sao_driver_firefly_data_t;
 
+
+
+/* ==== Driver registry ==== */
+
+// Known driver types; `SAO_DRIVER_UNKNOWN` for unknown or rejected drivers.
+typedef enum {
+    SAO_DRIVER_UNKNOWN,
+    SAO_DRIVER_APP,
+    SAO_DRIVER_BASIC_IO,
+    SAO_DRIVER_FIREFLY,
+    SAO_DRIVER_NEOPIXEL,
+    SAO_DRIVER_NTAG,
+    SAO_DRIVER_SSD1306,
+    SAO_DRIVER_STORAGE,
+    SAO_DRIVER_TYPE_MAX,
+} sao_driver_type_t;
+
 typedef struct {
     char    name[SAO_MAX_FIELD_LENGTH + 1];
     union {
@@ -156,11 +174,12 @@ typedef struct {
         sao_driver_storage_data_t  storage;
         sao_driver_basic_io_data_t basic_io;
         sao_driver_neopixel_data_t neopixel;
-        sao_driver_neopixel_data_t ssd1306;
+        sao_driver_ssd1306_data_t  ssd1306;
         sao_driver_ntag_data_t     ntag;
         sao_driver_firefly_data_t  firefly;
     };
     uint8_t data_length;
+    uint8_t type;  // sao_driver_type_t, filled in by `sao_dispatch_driver`
 } sao_driver_t;
 
 typedef struct {
@@ -168,8 +187,26 @@ typedef struct {
     char         name[SAO_MAX_FIELD_LENGTH + 1];
     uint8_t      amount_of_drivers;
     sao_driver_t drivers[SAO_MAX_NUM_DRIVERS];
+    // First valid driver of each type, pointing into `drivers`, or NULL.
+    sao_driver_t *by_type[SAO_DRIVER_TYPE_MAX];
 } SAO;
 
+typedef struct {
+    char const *name;
+    uint8_t     type;         // sao_driver_type_t
+    uint8_t     data_length;  // Minimum length of the driver data
+    // Checks and normalises the driver data; returns false to reject the driver.
+    bool (*parse)(sao_driver_t *driver);
+    // Makes a parsed driver available on the SAO.
+    void (*attach)(SAO *sao, sao_driver_t *driver);
+} sao_driver_handler_t;
+
+// Look up the handler for a driver name, or NULL if it is not known.
+sao_driver_handler_t const *sao_find_driver_handler(char const *name);
+// Validate, parse and attach one driver read from the SAO descriptor.
+// Unknown or invalid drivers are kept with type `SAO_DRIVER_UNKNOWN`.
+void sao_dispatch_driver(SAO *sao, sao_driver_t *driver);
+
 
 
 void dump_eeprom_contents();
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "eeprom.h"
+#include "sao_eeprom.h"
+
+// JSON SAO descriptors start with the magic "JSON", followed by one object:
+//   {"name": "Firefly friend", "drivers": [
+//       {"name": "storage", "data": [0, 80, 14, 6, 1, 0]},
+//       {"name": "app",     "data": "firefly"}
+//   ]}
+// Driver data is either an array of byte values or a string of raw bytes.
+// Unknown keys are skipped. The descriptor ends with the object, or at
+// SAO_JSON_MAX_LENGTH bytes, whichever comes first.
+
+// Bytes read from the EEPROM at a time; the largest supported page size.
+#define SAO_JSON_CHUNK      64
+// Maximum nesting depth, which bounds the parser's stack use.
+#define SAO_JSON_MAX_DEPTH  8
+// Maximum number of bytes scanned for a descriptor.
+#define SAO_JSON_MAX_LENGTH 4096
+
+// Parse a JSON descriptor from `eeprom` into `sao`.
+// Reads page-sized chunks and uses no heap; drivers are dispatched like binary ones.
+esp_err_t sao_identify_json(SAO* sao, EEPROM* eeprom);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Keeps the low-power mode from light-sleeping in the middle of work on core 1.
+// Light sleep stalls both cores, so an I2C transaction, the SPI DMA of a frame, an RMT
+// fade or a flash write caught by it would be cut off. Work holds a lock from when it is
+// handed over until it is done; the main task only sleeps while no lock is held, and new
+// locks wait until it is awake again.
+
+// Holds off light sleep until the matching sleep_lock_release; waits while the main task sleeps.
+void sleep_lock_acquire();
+// Releases a lock taken with sleep_lock_acquire.
+void sleep_lock_release();
+// For the main task: true if no lock is held, after which locks wait until sleep_lock_wake.
+bool sleep_lock_try_sleep();
+// For the main task: lets locks be taken again after sleeping.
+void sleep_lock_wake();
@@ -0,0 +1,6 @@
+#pragma once
+
+// The WiFi stack and the main task, which times the blinks and runs the radio, live on
+// core 0. Helper tasks (drawing, the glow, I2C, SAO probing and the trace writer) run on
+// the other core, so their work never holds up a blink or a packet.
+#define HELPER_TASK_CORE 1
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Packet trace format, shared by the badge and the host replay tool (sim/replay.c).
+// A trace is one trace_header_t followed by records, each a trace_record_t
+// followed by `len` bytes of raw packet data. Everything is little-endian.
+
+// Trace file magic.
+#define TRACE_MAGIC "FFTR"
+// Trace format version.
+#define TRACE_VERSION 1
+// RSSI value for when the radio driver doesn't report it.
+#define TRACE_RSSI_UNKNOWN -128
+
+// Bytes buffered between the radio and the writer task.
+#define TRACE_BUFFER_SIZE 8192
+// Flush the trace file at least this often, in milliseconds.
+#define TRACE_FLUSH_INTERVAL 1000
+// Stream the trace over the serial console instead of writing a file.
+#define TRACE_TO_SERIAL 0
+// Where the FAT partition is mounted.
+#define TRACE_MOUNT_POINT "/internal"
+// Line prefix for traces streamed over the serial console, as hex.
+#define TRACE_SERIAL_PREFIX "@FFTR "
+
+typedef struct __attribute__((__packed__)) {
+    uint8_t  magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    // Random ID of the badge that captured the trace.
+    uint32_t randid;
+} trace_header_t;
+
+typedef struct __attribute__((__packed__)) {
+    // Receive time in milliseconds since boot.
+    uint32_t time;
+    uint8_t  mac[6];
+    int8_t   rssi;
+    uint8_t  len;
+} trace_record_t;
+
+// Starts capturing into a new trace.
+bool trace_start(uint32_t randid);
+// Stops capturing and closes the trace.
+void trace_stop();
+// Whether a capture is running.
+bool trace_active();
+// Records a received packet; safe to call from the WiFi task, never blocks.
+void trace_record(int64_t now, uint8_t const *mac, int8_t rssi, uint8_t const *data, size_t len);
+// Number of records dropped because the buffer was full.
+uint32_t trace_dropped();
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <esp_system.h>
+#include "sao_eeprom.h"
+
+// Save the warm-start state at most this often, in milliseconds.
+#define WARM_SAVE_INTERVAL 60000
+
+// Keys in the warm-start log.
+#define WARM_KEY_ON_DURATION  0
+#define WARM_KEY_OFF_DURATION 1
+
+typedef struct {
+    // Converged LED on time.
+    int32_t led_on_duration;
+    // Converged LED off time.
+    int32_t led_off_duration;
+} warm_state_t;
+
+// Selects where the state is kept: the storage region of `sao` if it has one,
+// otherwise NVS. Cheap to call again; only reopens if the storage changed.
+void warm_start_open(SAO const* sao);
+// Loads the saved state; returns false if there is none.
+bool warm_start_load(warm_state_t* state);
+// Saves the state.
+esp_err_t warm_start_save(warm_state_t const* state);
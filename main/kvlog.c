@@ -0,0 +1,142 @@
+#include "kvlog.h"
+
+#include "i2c_eeprom.h"
+
+#include <esp_log.h>
+#include <stddef.h>
+#include <string.h>
+
+static const char* TAG = "kvlog";
+
+// First byte of every record.
+#define KVLOG_MAGIC 0xa5
+
+typedef struct __attribute__((__packed__)) {
+    uint8_t  magic;
+    uint8_t  key;
+    uint16_t seq;
+    uint8_t  value[KVLOG_VALUE_SIZE];
+    uint16_t reserved;  // Left erased (0xffff)
+    uint16_t check;     // Fletcher-16 over the bytes above
+} kvlog_record_t;
+
+_Static_assert(sizeof(kvlog_record_t) == KVLOG_RECORD_SIZE, "Record size mismatch");
+
+static uint16_t kvlog_checksum(kvlog_record_t const* record) {
+    uint8_t const* data = (uint8_t const*) record;
+    uint16_t       a = 0, b = 0;
+    for (size_t i = 0; i < offsetof(kvlog_record_t, check); i++) {
+        a = (a + data[i]) % 255;
+        b = (b + a) % 255;
+    }
+    return (b << 8) | a;
+}
+
+// Opens the log in `size` bytes starting at `start` of `eeprom`.
+// The region is shrunk to whole pages and to at most KVLOG_MAX_REGION.
+esp_err_t kvlog_open(kvlog_t* log, EEPROM const* eeprom, uint32_t start, uint32_t size) {
+    memset(log, 0, sizeof(kvlog_t));
+    log->eeprom = *eeprom;
+
+    uint32_t page = eeprom->page_size;
+    if (page < KVLOG_RECORD_SIZE || page % KVLOG_RECORD_SIZE || start % page) return ESP_ERR_INVALID_ARG;
+    if (size > KVLOG_MAX_REGION) size = KVLOG_MAX_REGION;
+    size -= size % page;
+    if (!size) return ESP_ERR_INVALID_SIZE;
+    log->start = start;
+    log->size  = size;
+
+    // Find the newest record of every key, and the newest record overall.
+    uint16_t key_seq[KVLOG_MAX_KEYS] = {0};
+    bool     any = false;
+    uint8_t  chunk[KVLOG_CHUNK];
+    for (uint32_t offset = 0; offset < size; offset += sizeof(chunk)) {
+        uint32_t len = size - offset < sizeof(chunk) ? size - offset : sizeof(chunk);
+        esp_err_t ec = i2c_eeprom_read(&log->eeprom, start + offset, chunk, len);
+        if (ec) return ec;
+
+        for (uint32_t i = 0; i + KVLOG_RECORD_SIZE <= len; i += KVLOG_RECORD_SIZE) {
+            kvlog_record_t record;
+            memcpy(&record, chunk + i, sizeof(record));
+            if (record.magic != KVLOG_MAGIC || record.key >= KVLOG_MAX_KEYS || record.check != kvlog_checksum(&record)) continue;
+
+            uint8_t bit = 1 << record.key;
+            if (!(log->valid & bit) || (int16_t) (record.seq - key_seq[record.key]) > 0) {
+                memcpy(log->values[record.key], record.value, KVLOG_VALUE_SIZE);
+                key_seq[record.key] = record.seq;
+                log->valid |= bit;
+            }
+            if (!any || (int16_t) (record.seq - log->seq) >= 0) {
+                log->seq  = record.seq;
+                log->next = (offset + i + KVLOG_RECORD_SIZE) % size;
+                any       = true;
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "Opened %u bytes at %u, next record at %u", size, start, log->next);
+    return ESP_OK;
+}
+
+// Reads `len` bytes of the value of `key`; returns false if it has no value.
+bool kvlog_get(kvlog_t const* log, uint8_t key, void* value, size_t len) {
+    if (key >= KVLOG_MAX_KEYS || !(log->valid & (1 << key))) return false;
+    if (len > KVLOG_VALUE_SIZE) len = KVLOG_VALUE_SIZE;
+    memcpy(value, log->values[key], len);
+    return true;
+}
+
+// Changes the value of `key` in memory; stored by the next commit.
+void kvlog_set(kvlog_t* log, uint8_t key, void const* value, size_t len) {
+    if (key >= KVLOG_MAX_KEYS) return;
+    if (len > KVLOG_VALUE_SIZE) len = KVLOG_VALUE_SIZE;
+
+    uint8_t tmp[KVLOG_VALUE_SIZE] = {0};
+    memcpy(tmp, value, len);
+    uint8_t bit = 1 << key;
+    if ((log->valid & bit) && !memcmp(log->values[key], tmp, KVLOG_VALUE_SIZE)) return;
+
+    memcpy(log->values[key], tmp, KVLOG_VALUE_SIZE);
+    log->valid |= bit;
+    log->dirty |= bit;
+}
+
+// Appends all keys to the log if any of them changed.
+esp_err_t kvlog_commit(kvlog_t* log) {
+    if (!log->dirty) return ESP_OK;
+
+    uint8_t  buf[KVLOG_MAX_KEYS * KVLOG_RECORD_SIZE];
+    uint32_t len = 0;
+    log->seq++;
+    for (uint8_t key = 0; key < KVLOG_MAX_KEYS; key++) {
+        if (!(log->valid & (1 << key))) continue;
+        kvlog_record_t record = {
+            .magic    = KVLOG_MAGIC,
+            .key      = key,
+            .seq      = log->seq,
+            .reserved = 0xffff,
+        };
+        memcpy(record.value, log->values[key], KVLOG_VALUE_SIZE);
+        record.check = kvlog_checksum(&record);
+        memcpy(buf + len, &record, sizeof(record));
+        len += sizeof(record);
+    }
+
+    // Don't straddle a page boundary if the commit fits in a page,
+    // and never wrap around the end of the region within a commit.
+    uint32_t page = log->eeprom.page_size;
+    uint32_t room = page - log->next % page;
+    if (len > log->size) return ESP_ERR_INVALID_SIZE;
+    if (len <= page && len > room) {
+        log->next = (log->next + room) % log->size;
+    }
+    if (len > log->size - log->next) {
+        log->next = 0;
+    }
+
+    esp_err_t ec = i2c_eeprom_write(&log->eeprom, log->start + log->next, buf, len);
+    if (ec) return ec;
+    log->next = (log->next + len) % log->size;
+    log->dirty = 0;
+    return ESP_OK;
+}
@@ -0,0 +1,183 @@
+#include "led_glow.h"
+
+#include <driver/gpio.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <string.h>
+#include "hardware.h"
+#include "mem_stats.h"
+#include "sleep_lock.h"
+#include "task_core.h"
+#include "ws2812.h"
+
+static const char *TAG = "glow";
+
+// Notification bit: fade in.
+#define GLOW_NOTIFY_ON     0x00000001
+// Notification bit: fade out.
+#define GLOW_NOTIFY_OFF    0x00000002
+// Notification bit: layout changed.
+#define GLOW_NOTIFY_LAYOUT 0x00000004
+
+// Stack size of the glow task.
+#define GLOW_TASK_STACK 2048
+
+// Firefly colour at full brightness.
+#define GLOW_COLOR_R 0xa0
+#define GLOW_COLOR_G 0xff
+#define GLOW_COLOR_B 0x10
+#define GLOW_COLOR_W 0x00
+
+// Brightness per fade step, gamma corrected (2.2) so the fade looks even.
+static const uint8_t glow_lut[GLOW_STEPS] = {
+      0,   0,   1,   1,   3,   5,   7,  10,  13,  17,  21,  26,  32,  38,  44,  52,
+     60,  68,  77,  87,  97, 108, 120, 132, 145, 159, 173, 188, 204, 220, 237, 255,
+};
+
+// Channel order per neopixel colour order, as defined in sao_eeprom.h.
+static const char *const glow_orders[SAO_DRIVER_NEOPIXEL_COLOR_ORDER_MAX] = {
+    "RGB",  "RBG",  "GRB",  "GBR",  "BRG",  "BGR",
+    "WRGB", "WRBG", "WGRB", "WGBR", "WBRG", "WBGR",
+    "RWGB", "RWBG", "RGWB", "RGBW", "RBWG", "RBGW",
+    "GWRB", "GWBR", "GRWB", "GRBW", "GBWR", "GBRW",
+    "BWRG", "BWGR", "BRWG", "BRGW", "BGWR", "BGRW",
+};
+
+// Precomputed frames, one for every fade step.
+static uint8_t glow_frames[GLOW_STEPS][GLOW_BADGE_LEDS * 3 + GLOW_MAX_SAO_LEDS * 4];
+// Length in bytes of one frame.
+static size_t glow_frame_len;
+// Requested number of SAO LEDs.
+static volatile uint16_t glow_sao_length = 0;
+// Requested colour order of the SAO LEDs.
+static volatile uint8_t glow_sao_order = SAO_DRIVER_NEOPIXEL_COLOR_ORDER_GRB;
+// The task streaming frames to the LEDs.
+static TaskHandle_t glow_task_handle;
+// Requests not picked up by the glow task yet, each holding a sleep lock.
+static uint32_t glow_requests = 0;
+// Guards `glow_requests`.
+static portMUX_TYPE glow_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Writes `length` LEDs in colour `order` at fade `step` to `out`; returns the end.
+static uint8_t *glow_fill(uint8_t *out, uint16_t length, uint8_t order, size_t step) {
+    char const *channels = glow_orders[order];
+    for (size_t led = 0; led < length; led++) {
+        for (char const *c = channels; *c; c++) {
+            uint8_t value;
+            switch (*c) {
+                case 'R': value = GLOW_COLOR_R; break;
+                case 'G': value = GLOW_COLOR_G; break;
+                case 'B': value = GLOW_COLOR_B; break;
+                default:  value = GLOW_COLOR_W; break;
+            }
+            *out++ = value * glow_lut[step] / 255;
+        }
+    }
+    return out;
+}
+
+// Precomputes all fade frames for the current layout: the badge's LEDs, then the SAO's.
+static void glow_build_frames() {
+    uint16_t length = glow_sao_length;
+    uint8_t  order  = glow_sao_order;
+
+    for (size_t step = 0; step < GLOW_STEPS; step++) {
+        uint8_t *end = glow_fill(glow_frames[step], GLOW_BADGE_LEDS, SAO_DRIVER_NEOPIXEL_COLOR_ORDER_GRB, step);
+        end = glow_fill(end, length, order, step);
+        glow_frame_len = end - glow_frames[step];
+    }
+}
+
+// Streams fade frames to the LEDs.
+static void glow_task(void *arg) {
+    int step   = 0;
+    int target = 0;
+    glow_build_frames();
+    ws2812_send_data(glow_frames[0], glow_frame_len);
+
+    // Sleep locks of the requests being drawn.
+    uint32_t locks = 0;
+    while (1) {
+        if (step == target) {
+            // Done; light sleep no longer freezes a half-finished fade.
+            for (; locks; locks--) sleep_lock_release();
+        }
+
+        // Sleep until notified, or until the next frame while fading.
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, step == target ? portMAX_DELAY : pdMS_TO_TICKS(GLOW_FRAME_INTERVAL));
+        portENTER_CRITICAL(&glow_mux);
+        locks += glow_requests;
+        glow_requests = 0;
+        portEXIT_CRITICAL(&glow_mux);
+
+        if (bits & GLOW_NOTIFY_ON) target = GLOW_STEPS - 1;
+        if (bits & GLOW_NOTIFY_OFF) target = 0;
+        if (bits & GLOW_NOTIFY_LAYOUT) {
+            // Blank the old layout before switching.
+            memset(glow_frames[0], 0, glow_frame_len);
+            ws2812_send_data(glow_frames[0], glow_frame_len);
+            glow_build_frames();
+        } else if (step == target) {
+            continue;
+        }
+
+        if (step < target) {
+            step += GLOW_RISE_STEPS;
+            if (step > target) step = target;
+        } else if (step > target) {
+            step -= GLOW_FALL_STEPS;
+            if (step < target) step = target;
+        }
+        ws2812_send_data(glow_frames[step], glow_frame_len);
+    }
+}
+
+// Starts the WS2812 glow output on the badge's LEDs.
+esp_err_t led_glow_init() {
+    // The LEDs share their power supply with the SD card.
+    gpio_set_direction(GPIO_SD_PWR, GPIO_MODE_OUTPUT);
+    gpio_set_level(GPIO_SD_PWR, 1);
+
+    esp_err_t ec = ws2812_init(GPIO_LED_DATA);
+    if (ec) {
+        ESP_LOGE(TAG, "Failed to initialise WS2812: %s", esp_err_to_name(ec));
+        return ec;
+    }
+
+    if (xTaskCreatePinnedToCore(glow_task, "glow", GLOW_TASK_STACK, NULL, 2, &glow_task_handle, HELPER_TASK_CORE) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    mem_stats_add_region("glow frames", sizeof(glow_frames));
+    mem_stats_add_task("glow", glow_task_handle, GLOW_TASK_STACK);
+    return ESP_OK;
+}
+
+// Notifies the glow task with GLOW_NOTIFY_* `bits`; light sleep waits until it is done.
+static void glow_request(uint32_t bits) {
+    if (!glow_task_handle) return;
+    sleep_lock_acquire();
+    portENTER_CRITICAL(&glow_mux);
+    glow_requests++;
+    portEXIT_CRITICAL(&glow_mux);
+    xTaskNotify(glow_task_handle, bits, eSetBits);
+}
+
+// Also draws the glow on `sao_length` neopixel SAO LEDs in `sao_order`, after the badge's own; 0 for none.
+// Frames are only recomputed if the layout actually changed.
+void led_glow_set_layout(uint16_t sao_length, uint8_t sao_order) {
+    if (sao_length > GLOW_MAX_SAO_LEDS) sao_length = GLOW_MAX_SAO_LEDS;
+    if (sao_order >= SAO_DRIVER_NEOPIXEL_COLOR_ORDER_MAX) sao_order = SAO_DRIVER_NEOPIXEL_COLOR_ORDER_GRB;
+    if (sao_length == glow_sao_length && sao_order == glow_sao_order) return;
+
+    ESP_LOGI(TAG, "Layout: %u SAO LEDs, order %s", sao_length, glow_orders[sao_order]);
+    glow_sao_length = sao_length;
+    glow_sao_order  = sao_order;
+    glow_request(GLOW_NOTIFY_LAYOUT);
+}
+
+// Starts fading the glow in or out; does not block.
+void led_glow_set(bool on) {
+    glow_request(on ? GLOW_NOTIFY_ON : GLOW_NOTIFY_OFF);
+}
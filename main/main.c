@@ -10,8 +10,20 @@
 
 #include "main.h"
 #include "esp_now.h"
+#include "espnow_tx.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "firefly_sync.h"
+#include "i2c_sched.h"
+#include "led_glow.h"
+#include "mem_stats.h"
+#include "rx_filter.h"
+#include "sleep_lock.h"
+#include "task_core.h"
+#include "trace.h"
+#include "warm_start.h"
+#include "esp_sleep.h"
+#include "driver/gpio.h"
 #include "pax_codecs.h"
 #include "sao_eeprom.h"
 #include "string.h"
@@ -44,31 +56,17 @@ void exit_to_launcher() {
 // Time between SAO detecting moments.
 #define SAO_DETECT_INTERVAL 1000
 
-// Minimum LED on time (for cycle).
-#define LED_ON_DURATION_MIN_RNG 1000
-// Minimum LED on time (for sync).
-#define LED_ON_DURATION_MIN 1000
-// Maximum LED on time.
-#define LED_ON_DURATION_MAX 1250
-// Maximum LED on time drift.
-#define LED_ON_DURATION_DRIFT 50
-
-// Minimum LED off time (for cycle).
-#define LED_OFF_DURATION_MIN_RNG 3000
-// Minimum LED off time (for sync).
-#define LED_OFF_DURATION_MIN 1500
-// Maximum LED off time.
-#define LED_OFF_DURATION_MAX 5000
-// Maximum LED off time drift.
-#define LED_OFF_DURATION_DRIFT 100
-
-// Synchronisation error time.
-#define LED_SYNC_ERROR_MIN 100
-// Synchronisation error time.
-#define LED_SYNC_ERROR_MAX 250
-
-// Probability of hearing packet in perect.
-#define PACKET_HEARD_PERCENT 100
+// Minimum time between two UI frames in milliseconds.
+#define UI_FRAME_INTERVAL 100
+// Stack size of the render task.
+#define RENDER_TASK_STACK 8192
+// Screen size in pixels.
+#define SCREEN_WIDTH  320
+#define SCREEN_HEIGHT 240
+// Time between redraws of the debug page, so the memory statistics stay current.
+#define DEBUG_REFRESH_INTERVAL 1000
+// Stack size of the SAO probe task.
+#define SAO_TASK_STACK 4096
 
 // Last SAO detection time.
 int64_t sao_detect_time = 0;
@@ -76,153 +74,132 @@ int64_t sao_detect_time = 0;
 bool sao_detected = false;
 // Is the blinking enabled?
 bool blink_enable = false;
-// Current LED state.
-volatile bool led_state = false;
-// Current LED on time setting.
-volatile int64_t led_on_duration;
-// Current LED off time setting.
-volatile int64_t led_off_duration;
-// Start of the last blink time.
-volatile int64_t last_blink_time;
-// Random ID decided at startup.
-uint32_t randid;
+// Firefly synchronisation state.
+sync_t sync;
+// Filter in front of the sync logic; used by the WiFi task only.
+rx_filter_t rx_filter;
 // Number of detected fireflies.
 size_t firefly_count = 0;
 // Last time of sending ping.
 int64_t last_ping_time = 0;
+// Has the warm-start state been looked for?
+bool warm_loaded = false;
+// Last time the warm-start state was saved.
+int64_t warm_save_time = 0;
+// Is the radio currently on?
+bool radio_on = true;
+// Total time with the radio on since the low-power mode was turned on, for its statistics.
+int64_t radio_on_time = 0;
+// Time the low-power mode was last turned on.
+int64_t low_power_time = 0;
+// Last time the radio on time was accounted.
+int64_t radio_stat_time = 0;
+// Is the debug page shown instead of the normal UI?
+bool debug_page = false;
+// Last time the debug page was redrawn.
+int64_t debug_draw_time = 0;
 
 // The LED TIME MUTEX.
 SemaphoreHandle_t mtx;
-
-// Pinging interval in milliseconds.
-#define PING_INTERVAL 1000
-// Amount of IDs to keep track of at most.
-#define ID_TABLE_LEN 1337
-// Maximum age of IDs in milliseconds.
-#define ID_TIMEOUT 6000
-// LEDs turning ON flag.
-#define PACKET_FLAG_LED_ON 0x00000001
-// LEDs turning OFF flag.
-#define PACKET_FLAG_LED_OFF 0x00000002
-// Firefly detected flag.
-#define PACKET_FLAG_SAO 0x00000004
-
-// Randid buffer.
-uint32_t id_table[ID_TABLE_LEN];
-// Randid recv timestamp.
-int64_t id_time_table[ID_TABLE_LEN];
+// The render task, which owns the screen.
+TaskHandle_t render_task_handle;
+// The SAO probe task.
+TaskHandle_t sao_task_handle;
+// Given by the probe task when `sao` holds a new result.
+SemaphoreHandle_t sao_probed;
+// Given by the main task when it is done with `sao`.
+SemaphoreHandle_t sao_handled;
+// Result of the last probe; was a firefly SAO found?
+bool sao_probe_found = false;
+// Warm-start state for the probe task to save; holds only the newest.
+QueueHandle_t warm_queue;
 
 static uint8_t const broadcast_mac[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
-static uint8_t const packet_magic[] = "SAO.Firefly";
-typedef struct {
-    uint8_t magic[sizeof(packet_magic)];
-    uint32_t flags;
-    uint32_t total_duration;
-    uint32_t randid;
-} packet_t;
 
 SAO sao;
 sao_driver_firefly_data_t firefly_data;
 
 bool firefly_detect() {
+    bool     found       = false;
+    uint16_t glow_length = 0;
+    uint8_t  glow_order  = SAO_DRIVER_NEOPIXEL_COLOR_ORDER_GRB;
     if (!sao_identify(&sao)) {
-        for (size_t i = 0; i < sao.amount_of_drivers; i++) {
-            if (!strcmp(sao.drivers[i].name, SAO_DRIVER_FIREFLY_NAME)) {
-                firefly_data = sao.drivers[i].firefly;
-                return true;
-            }
+        if (sao.by_type[SAO_DRIVER_FIREFLY]) {
+            firefly_data = sao.by_type[SAO_DRIVER_FIREFLY]->firefly;
+            found = true;
+        }
+        if (sao.by_type[SAO_DRIVER_NEOPIXEL]) {
+            // Mirror the blink on the neopixel SAO too; its LEDs follow the badge's on the data line.
+            glow_length = sao.by_type[SAO_DRIVER_NEOPIXEL]->neopixel.length;
+            glow_order  = sao.by_type[SAO_DRIVER_NEOPIXEL]->neopixel.color_order;
         }
     }
-    return false;
+    led_glow_set_layout(glow_length, glow_order);
+    return found;
 }
 
-void espnow_recv(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
-    int64_t now = esp_timer_get_time() / 1000;
-
-    if (data_len < sizeof(packet_t)) {
-        // Too short; ignore this packet.
-        ESP_LOGE("espnow", "Packet too short");
-        return;
-    }
-    packet_t packet = *(packet_t const *)data;
-    if (memcmp(packet.magic, packet_magic, sizeof(packet_magic))) {
-        // Invalid magic; ignore this packet.
-        ESP_LOGE("espnow", "Invalid magic");
-        return;
-    }
-
-    xSemaphoreTake(mtx, portMAX_DELAY);
-    uint32_t total_duration = led_on_duration + led_off_duration;
-    if (total_duration < packet.total_duration) {
-        // We're too fase; increase cycle time.
-        led_off_duration += (int) (esp_random() % LED_ON_DURATION_DRIFT) - LED_ON_DURATION_DRIFT / 4;
-        if (led_off_duration > LED_OFF_DURATION_MAX) led_off_duration = LED_OFF_DURATION_MAX;
-    } else if (total_duration > packet.total_duration) {
-        // We're too slow; decrease cycle time.
-        led_off_duration -= (int) (esp_random() % LED_ON_DURATION_DRIFT) - LED_ON_DURATION_DRIFT / 4;
-        if (led_off_duration < LED_OFF_DURATION_MIN) led_off_duration = LED_OFF_DURATION_MIN;
-    }
-
-    bool has_update = false;
-    for (size_t i = 0; i < ID_TABLE_LEN; i++) {
-        if (id_table[i] == packet.randid) {
-            ESP_LOGD("espnow", "Update i=%zu randid=%u", i, packet.randid);
-            id_time_table[i] = now;
-            has_update = true;
-            break;
-        }
-    }
-    if (!has_update) {
-        for (size_t i = 0; i < ID_TABLE_LEN; i++) {
-            if (now > id_time_table[i] + ID_TIMEOUT) {
-                ESP_LOGD("espnow", "Replace i=%zu randid=%u", i, packet.randid);
-                id_table[i] = packet.randid;
-                id_time_table[i] = now;
-                break;
+// Probes the SAO every SAO_DETECT_INTERVAL, so the main task never waits for a scan.
+// Also does all warm-start storage access, which goes over the same bus.
+void sao_task(void *arg) {
+    while (1) {
+        sao_probe_found = firefly_detect();
+        // Keep the warm-start state on the SAO if it has storage.
+        warm_start_open(sao_probe_found ? &sao : NULL);
+        xSemaphoreGive(sao_probed);
+        // `sao` belongs to the main task until it has handled the result.
+        xSemaphoreTake(sao_handled, portMAX_DELAY);
+
+        // Until the next probe, save the warm-start state whenever the main task hands one over.
+        TickType_t next = xTaskGetTickCount() + pdMS_TO_TICKS(SAO_DETECT_INTERVAL);
+        while (1) {
+            TickType_t left = next - xTaskGetTickCount();
+            if (left == 0 || left > pdMS_TO_TICKS(SAO_DETECT_INTERVAL)) break;
+            warm_state_t warm;
+            if (xQueueReceive(warm_queue, &warm, left)) {
+                // The NVS fallback writes to flash, which light sleep must not interrupt.
+                sleep_lock_acquire();
+                warm_start_save(&warm);
+                sleep_lock_release();
             }
         }
     }
+}
 
-    if (packet.flags & PACKET_FLAG_LED_ON) {
-        // LED turned on.
-        ESP_LOGD("espnow", "Recv ON  packet");
-        if (now - last_blink_time < led_on_duration + LED_OFF_DURATION_MIN) {
-            // Cannot blink right now.
-        } else if (!led_state && now > last_blink_time + led_on_duration + LED_OFF_DURATION_MIN) {
-            // Acceptable timing; turns ON.
-            last_blink_time = now + (int) (esp_random() % (LED_SYNC_ERROR_MAX - LED_SYNC_ERROR_MIN)) + LED_SYNC_ERROR_MIN;
-        }
-    }
-    xSemaphoreGive(mtx);
+// Switches the firefly LED, which is active low; `arg` is non-zero for on.
+static esp_err_t firefly_led_job(void *arg) {
+    return rp2040_set_gpio_value(get_rp2040(), FIREFLY_LED_PIN, !arg);
 }
 
-void espnow_send_off() {
-    packet_t packet;
-    memcpy(packet.magic, packet_magic, sizeof(packet_magic));
-    packet.flags = PACKET_FLAG_LED_OFF | PACKET_FLAG_SAO * sao_detected;
-    packet.total_duration = led_on_duration + led_off_duration;
-    packet.randid = randid;
-    esp_now_send(broadcast_mac, (void const *)&packet, sizeof(packet));
-    ESP_LOGD("espnow", "Send OFF packet");
+// Makes the firefly LED pin an output.
+static esp_err_t firefly_led_init_job(void *arg) {
+    return rp2040_set_gpio_dir(get_rp2040(), FIREFLY_LED_PIN, true);
 }
 
-void espnow_send_on() {
-    packet_t packet;
-    memcpy(packet.magic, packet_magic, sizeof(packet_magic));
-    packet.flags = PACKET_FLAG_LED_ON | PACKET_FLAG_SAO * sao_detected;
-    packet.total_duration = led_on_duration + led_off_duration;
-    packet.randid = randid;
-    esp_now_send(broadcast_mac, (void const *)&packet, sizeof(packet));
-    ESP_LOGD("espnow", "Send ON  packet");
+void espnow_recv(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
+    int64_t now = esp_timer_get_time() / 1000;
+    // This IDF's receive callback does not report RSSI.
+    trace_record(now, mac_addr, TRACE_RSSI_UNKNOWN, data, data_len);
+    // Rejected packets are only counted, and never wait for the mutex.
+    if (rx_filter_check(&rx_filter, now, mac_addr, data, data_len) != RX_ACCEPT) return;
+    xSemaphoreTake(mtx, portMAX_DELAY);
+    sync_recv(&sync, now, data, data_len);
+    xSemaphoreGive(mtx);
+}
+
+// Sends an ON or OFF announcement from sync_announce; must be called with `mtx` held.
+void espnow_send_edge(int64_t now, uint32_t flags) {
+    clock_packet_t packet;
+    size_t len = sync_make_clock_packet(&sync, now, &packet, flags | PACKET_FLAG_SAO * sao_detected);
+    espnow_tx_queue(ESPNOW_TX_EDGE, now, &packet, len);
+    ESP_LOGD("espnow", "Send %s packet", flags & PACKET_FLAG_LED_ON ? "ON " : "OFF");
 }
 
-void espnow_send_ping() {
-    packet_t packet;
-    memcpy(packet.magic, packet_magic, sizeof(packet_magic));
-    packet.flags = PACKET_FLAG_SAO * sao_detected;
-    packet.total_duration = led_on_duration + led_off_duration;
-    packet.randid = randid;
-    esp_now_send(broadcast_mac, (void const *)&packet, sizeof(packet));
+void espnow_send_ping(int64_t now) {
+    clock_packet_t packet;
+    xSemaphoreTake(mtx, portMAX_DELAY);
+    size_t len = sync_make_clock_packet(&sync, now, &packet, PACKET_FLAG_SAO * sao_detected);
+    xSemaphoreGive(mtx);
+    espnow_tx_queue(ESPNOW_TX_PING, now, &packet, len);
     ESP_LOGD("espnow", "Send HI  packet");
 }
 
@@ -244,6 +221,8 @@ void espnow_init() {
     esp_now_init();
     // Register callback for incoming data.
     esp_now_register_recv_cb(espnow_recv);
+    // Track what the driver does with our packets.
+    espnow_tx_init(broadcast_mac);
 
     // Add the broadcast peer.
     esp_now_peer_info_t peer = {
@@ -255,32 +234,118 @@ void espnow_init() {
     esp_now_add_peer(&peer);
 }
 
-void randomise_times() {
-    led_on_duration +=
-            (int)(esp_random() % LED_ON_DURATION_DRIFT) - LED_ON_DURATION_DRIFT / 2;
-    if (led_on_duration < LED_ON_DURATION_MIN_RNG)
-        led_on_duration = LED_ON_DURATION_MIN_RNG;
-    if (led_on_duration > LED_ON_DURATION_MAX)
-        led_on_duration = LED_ON_DURATION_MAX;
-
-    led_off_duration += (int) (esp_random() % LED_OFF_DURATION_DRIFT) - LED_OFF_DURATION_DRIFT / 2;
-    if (led_off_duration < LED_OFF_DURATION_MIN) led_off_duration = LED_OFF_DURATION_MIN;
-    if (led_off_duration > LED_OFF_DURATION_MAX) led_off_duration = LED_OFF_DURATION_MAX;
+// Turns the radio on or off for the low-power mode.
+void radio_set(bool on, int64_t now) {
+    if (radio_on) radio_on_time += now - radio_stat_time;
+    radio_stat_time = now;
+    if (on == radio_on) return;
+    radio_on = on;
+    if (on) {
+        esp_wifi_start();
+    } else {
+        esp_wifi_stop();
+        espnow_tx_reset();
+    }
+}
+
+// Restores the period saved by a previous run, if any.
+void warm_start_restore() {
+    warm_state_t state;
+    if (!warm_start_load(&state)) {
+        ESP_LOGI("warm", "No saved state, starting cold");
+        return;
+    }
+    ESP_LOGI("warm", "Restoring on=%d off=%d", state.led_on_duration, state.led_off_duration);
+    xSemaphoreTake(mtx, portMAX_DELAY);
+    sync_warm_start(&sync, state.led_on_duration, state.led_off_duration);
+    xSemaphoreGive(mtx);
+}
+
+// Light-sleeps until the next listen window or a button press.
+void low_power_sleep(int64_t now) {
+    xSemaphoreTake(mtx, portMAX_DELAY);
+    int64_t wake = sync_next_wake(&sync, now);
+    bool    on   = sync.led_state;
+    xSemaphoreGive(mtx);
+    // Don't cut the glow short or sleep for nothing.
+    if (on || wake - now < LP_MIN_SLEEP) return;
+    // Work on core 1 would be stalled halfway; try again on the next round.
+    if (!sleep_lock_try_sleep()) return;
+
+    esp_sleep_enable_timer_wakeup((wake - now) * 1000);
+    gpio_wakeup_enable(GPIO_INT_RP2040, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+    esp_light_sleep_start();
+    sleep_lock_wake();
+}
+
+// Draws line `line` of the debug page.
+static void draw_debug_line(int line, pax_col_t col, char const *text) {
+    pax_draw_text(&buf, col, pax_font_sky_mono, 9, 30, 5 + line * 9, text);
 }
 
+// Draws the blink timing and the memory statistics.
 void draw_debug() {
-    // Debug information.
-    pax_col_t col = led_state ? 0xffff0000 : 0xff3f0000;
+    pax_col_t col = sync.led_state ? 0xffff0000 : 0xff3f0000;
     pax_draw_rect(&buf, col, 5, 5, 20, 20);
-    char txtbuf[256];
-    snprintf(txtbuf, sizeof(txtbuf) - 1, "On:  %4llu\nOff: %4llu\nTot: %4llu", led_on_duration, led_off_duration, led_on_duration + led_off_duration);
-    pax_draw_text(&buf, 0xffffffff, pax_font_sky_mono, 9, 30, 5, txtbuf);
+
+    // Lines are drawn one at a time, so one short buffer will do.
+    char line[48];
+    int  y = 0;
+    snprintf(line, sizeof(line), "On: %4llu  Off: %4llu  Tot: %4llu", sync.led_on_duration, sync.led_off_duration, sync.led_on_duration + sync.led_off_duration);
+    draw_debug_line(y++, 0xffffffff, line);
+    for (int i = 0; i < I2C_PRIOS; i++) {
+        i2c_sched_stats_t stats;
+        i2c_sched_get_stats(i, &stats);
+        uint32_t avg = stats.jobs ? stats.wait_total_us / stats.jobs : 0;
+        snprintf(line, sizeof(line), "I2C %-6s %6u wait %4u/%6u us -%u", i2c_prio_names[i], stats.jobs, avg, stats.wait_max_us, stats.dropped);
+        draw_debug_line(y++, stats.dropped ? 0xffff0000 : 0xffffffff, line);
+    }
+    for (int i = 0; i < ESPNOW_TX_TYPES; i++) {
+        espnow_tx_stats_t stats;
+        espnow_tx_get_stats(i, &stats);
+        uint32_t avg = stats.sent ? stats.latency_total_us / stats.sent : 0;
+        snprintf(line, sizeof(line), "TX %-4s %5u/%5u ok %4u/%6u us -%u", espnow_tx_names[i], stats.sent, stats.queued, avg, stats.latency_max_us, stats.failed);
+        draw_debug_line(y++, stats.failed ? 0xffff0000 : 0xffffffff, line);
+    }
+
+    // Only the render task draws, so the snapshot can live outside its stack.
+    static mem_snapshot_t snapshot;
+    mem_stats_sample(&snapshot);
+    y++;
+    for (size_t i = 0; i < MEM_HEAPS; i++) {
+        mem_heap_t const *heap = &snapshot.heaps[i];
+        if (!heap->total) continue;
+        snprintf(line, sizeof(line), "%-8s %4u/%4uk min %4uk blk %4uk", mem_heap_names[i],
+            heap->free / 1024, heap->total / 1024, heap->min_free / 1024, heap->largest / 1024);
+        draw_debug_line(y++, 0xffffffff, line);
+    }
+    y++;
+    for (size_t i = 0; i < snapshot.region_count; i++) {
+        snprintf(line, sizeof(line), "%-12s %7u", snapshot.regions[i].name, snapshot.regions[i].size);
+        draw_debug_line(y++, 0xffffffff, line);
+    }
+    snprintf(line, sizeof(line), "%-12s %7u", "fixed total", snapshot.region_total);
+    draw_debug_line(y++, 0xffffffff, line);
+    y++;
+    for (size_t i = 0; i < snapshot.task_count; i++) {
+        mem_task_t const *task = &snapshot.tasks[i];
+        if (task->stack_size) {
+            snprintf(line, sizeof(line), "%-8s stack %5u free of %5u", task->name, task->stack_free, task->stack_size);
+        } else {
+            snprintf(line, sizeof(line), "%-8s stack %5u free", task->name, task->stack_free);
+        }
+        draw_debug_line(y++, task->stack_free < MEM_STACK_LOW ? 0xffff0000 : 0xffffffff, line);
+    }
 }
 
 void draw_ui() {
     pax_background(&buf, 0);
 
-    if (!blink_enable && !sao_detected) {
+    if (debug_page) {
+        draw_debug();
+
+    } else if (!blink_enable && !sao_detected) {
         // Show an INFO.
         pax_insert_png_buf(&buf, firefly_qr_start, firefly_qr_end-firefly_qr_start, 104, 64, 0);
         pax_center_text(&buf, 0xffffffff, pax_font_saira_regular, 18, 160, 10, "Firefly not detected!");
@@ -295,11 +360,54 @@ void draw_ui() {
         char tmp[32];
         snprintf(tmp, sizeof(tmp)-1, "%d %s nearby.", firefly_count, firefly_count == 1 ? "firefly" : "fireflies");
         pax_center_text(&buf, 0xffffffff, pax_font_saira_regular, 18, 160, 212, tmp);
+        if (trace_active()) {
+            pax_center_text(&buf, 0xffff0000, pax_font_saira_regular, 18, 160, 28, "Recording packets");
+        }
+        if (sync.clock_mode) {
+            pax_center_text(&buf, 0xffffffff, pax_font_saira_regular, 18, 160, 176,
+                !sync_clock_valid(&sync) ? "Swarm clock: waiting" : sync.clock_ref == sync.randid ? "Swarm clock: reference" : "Swarm clock");
+        }
+        if (sync.low_power) {
+            // Show how much of the time the radio is on.
+            int64_t now = esp_timer_get_time() / 1000;
+            int64_t since = now - low_power_time;
+            snprintf(tmp, sizeof(tmp)-1, "Low power: radio %d%%", (int) (radio_on_time * 100 / (since ? since : 1)));
+            pax_center_text(&buf, 0xffffffff, pax_font_saira_regular, 18, 160, 194, tmp);
+        }
     }
 
     disp_flush();
 }
 
+// Tells the render task the UI needs to be redrawn.
+// Requests made before the next frame coalesce into a single redraw.
+void ui_mark_dirty() {
+    if (render_task_handle) xTaskNotifyGive(render_task_handle);
+}
+
+// Draws at most one frame per UI_FRAME_INTERVAL, only when marked dirty.
+void render_task(void *arg) {
+    int64_t last_frame_time = -UI_FRAME_INTERVAL;
+    while (1) {
+        // Wait until something changed.
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Hold off until the frame interval has passed.
+        int64_t now = esp_timer_get_time() / 1000;
+        if (now < last_frame_time + UI_FRAME_INTERVAL) {
+            vTaskDelay(pdMS_TO_TICKS(last_frame_time + UI_FRAME_INTERVAL - now));
+        }
+        // Anything marked dirty while waiting is covered by this frame.
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        last_frame_time = esp_timer_get_time() / 1000;
+        // Light sleep would stall the SPI DMA of the frame.
+        sleep_lock_acquire();
+        draw_ui();
+        sleep_lock_release();
+    }
+}
+
 void app_main() {
     ESP_LOGI(TAG, "Welcome to the template app!");
 
@@ -309,86 +417,139 @@ void app_main() {
     // Initialize the RP2040 (responsible for buttons, etc).
     bsp_rp2040_init();
 
+    // Share the I2C bus between the LED, the RP2040 and the SAO.
+    i2c_sched_init();
+
     // This queue is used to receive button presses.
     buttonQueue = get_rp2040()->queue;
 
     // Initialize graphics for the screen.
-    pax_buf_init(&buf, NULL, 320, 240, PAX_BUF_16_565RGB);
+    pax_buf_init(&buf, NULL, SCREEN_WIDTH, SCREEN_HEIGHT, PAX_BUF_16_565RGB);
 
     // Init butterfly pins.
-    rp2040_set_gpio_dir(get_rp2040(), FIREFLY_LED_PIN, true);
+    i2c_sched_run(I2C_PRIO_RP2040, firefly_led_init_job, NULL);
+
+    // Init the LEDs mirroring the firefly.
+    led_glow_init();
 
-    // Initial randomisation.
-    led_on_duration  = esp_random() % (LED_ON_DURATION_MAX  - LED_ON_DURATION_MIN)  + LED_ON_DURATION_MIN;
-    led_off_duration = esp_random() % (LED_OFF_DURATION_MAX - LED_OFF_DURATION_MIN) + LED_OFF_DURATION_MIN;
-    
     // Init mutex.
     mtx = xSemaphoreCreateMutex();
-    for (size_t i = 0; i < ID_TABLE_LEN; i++) {
-        id_time_table[i] = -ID_TIMEOUT;
-    }
 
     // Init networking.
     nvs_flash_init();
     wifi_init();
-    randid = esp_random();
+    sync_init(&sync, esp_random());
+    rx_filter_init(&rx_filter, esp_timer_get_time() / 1000);
     espnow_init();
 
+    // Start rendering on the helper core.
+    xTaskCreatePinnedToCore(render_task, "render", RENDER_TASK_STACK, NULL, 1, &render_task_handle, HELPER_TASK_CORE);
+
+    // Probe the SAO in the background; its EEPROM reads queue behind the LED.
+    sao_probed  = xSemaphoreCreateBinary();
+    sao_handled = xSemaphoreCreateBinary();
+    warm_queue  = xQueueCreate(1, sizeof(warm_state_t));
+    xTaskCreatePinnedToCore(sao_task, "sao", SAO_TASK_STACK, NULL, 1, &sao_task_handle, HELPER_TASK_CORE);
+
+    // Account for the big allocations and the tasks; the glow and trace modules add their own.
+    mem_stats_add_region("framebuffer", SCREEN_WIDTH * SCREEN_HEIGHT * 2);
+    mem_stats_add_region("sync", sizeof(sync));
+    mem_stats_add_region("rx filter", sizeof(rx_filter));
+    mem_stats_add_region("SAO", sizeof(sao));
+    mem_stats_add_task("main", xTaskGetCurrentTaskHandle(), CONFIG_ESP_MAIN_TASK_STACK_SIZE);
+    mem_stats_add_task("wifi", xTaskGetHandle("wifi"), 0);
+    mem_stats_add_task("render", render_task_handle, RENDER_TASK_STACK);
+    mem_stats_add_task("sao", sao_task_handle, SAO_TASK_STACK);
+
     while (1) {
         int64_t now = esp_timer_get_time() / 1000;
 
-        if (now > last_ping_time + PING_INTERVAL) {
-            espnow_send_ping();
+        // Hand over packets that waited for the driver.
+        if (radio_on) espnow_tx_pump(now);
+
+        if (radio_on && now > last_ping_time + PING_INTERVAL) {
+            espnow_send_ping(now);
             last_ping_time = now;
         }
 
-        if (now > sao_detect_time + SAO_DETECT_INTERVAL) {
+        rx_filter_stats_t rejects;
+        if (rx_filter_summary(&rx_filter, now, &rejects)) {
+            ESP_LOGW("espnow", "Rejected in %d s: %u short, %u invalid magic, %u sender flooding, %u swarm flooding (%u accepted)",
+                RX_SUMMARY_INTERVAL / 1000, rejects.count[RX_REJECT_SHORT], rejects.count[RX_REJECT_MAGIC],
+                rejects.count[RX_REJECT_SENDER], rejects.count[RX_REJECT_SWARM], rejects.count[RX_ACCEPT]);
+        }
+
+        if (debug_page && now > debug_draw_time + DEBUG_REFRESH_INTERVAL) {
+            ui_mark_dirty();
+            debug_draw_time = now;
+        }
+
+        if (xSemaphoreTake(sao_probed, 0)) {
             bool pdet = sao_detected;
-            sao_detected = firefly_detect();
+            sao_detected = sao_probe_found;
             if (pdet && !sao_detected) {
                 ESP_LOGI("firefly", "SAO firefly disconnected");
                 blink_enable = false;
-                draw_ui();
+                led_glow_set(false);
+                ui_mark_dirty();
             } else if (!pdet && sao_detected) {
                 ESP_LOGI("firefly", "SAO firefly detected:");
                 ESP_LOGI("firefly", "    Batch:  %d", firefly_data.batch_no);
                 ESP_LOGI("firefly", "    Rev.:   %d", firefly_data.hardware_ver);
                 ESP_LOGI("firefly", "    Serial: %d", firefly_data.serial_no_lo + firefly_data.serial_no_hi * 256);
                 blink_enable = true;
-                draw_ui();
+                ui_mark_dirty();
             } else if (sao_detect_time == 0) {
-                draw_ui();
+                ui_mark_dirty();
             }
             sao_detect_time = now;
+
+            // The probe task has opened the warm-start storage.
+            if (!warm_loaded) {
+                warm_start_restore();
+                warm_loaded = true;
+            }
+            xSemaphoreGive(sao_handled);
         }
 
         if (blink_enable) {
             xSemaphoreTake(mtx, portMAX_DELAY);
-            size_t on = 0;
-            for (size_t i = 0; i < ID_TABLE_LEN; i++) {
-                if (id_time_table[i] + ID_TIMEOUT > now) {
-                    on++;
-                }
-            }
+            size_t on = sync_count_peers(&sync, now);
             if (firefly_count != on) {
                 firefly_count = on;
-                draw_ui();
+                ui_mark_dirty();
             }
 
-            if (now > last_blink_time + led_on_duration && led_state) {
+            int edge = sync_tick(&sync, now);
+            if (edge == SYNC_EDGE_OFF) {
                 // Turn OFF LED.
-                led_state = false;
-                rp2040_set_gpio_value(get_rp2040(), 1, true);
-                espnow_send_off();
-            } else if (now >= last_blink_time && (now < last_blink_time + led_on_duration || now > last_blink_time + led_on_duration + led_off_duration) && !led_state) {
+                i2c_sched_post(I2C_PRIO_LED, firefly_led_job, (void *) false);
+                led_glow_set(false);
+            } else if (edge == SYNC_EDGE_ON) {
                 // Turn ON LED.
-                led_state = true;
-                last_blink_time = now;
-                rp2040_set_gpio_value(get_rp2040(), 1, false);
-                espnow_send_on();
-                randomise_times();
+                i2c_sched_post(I2C_PRIO_LED, firefly_led_job, (void *) true);
+                led_glow_set(true);
             }
+            // Edges are announced a little later, unless enough peers already did.
+            uint32_t announce = sync_announce(&sync, now);
+            if (announce) espnow_send_edge(now, announce);
+            bool need_radio = sync_radio_needed(&sync, now);
+            bool save_warm  = edge == SYNC_EDGE_OFF && sync_converged(&sync) && now > warm_save_time + WARM_SAVE_INTERVAL;
+            warm_state_t warm = {
+                .led_on_duration  = sync.led_on_duration,
+                .led_off_duration = sync.led_off_duration,
+            };
             xSemaphoreGive(mtx);
+
+            radio_set(need_radio, now);
+            if (save_warm) {
+                // In sync; remember the period for the next boot. The probe task writes it,
+                // so the write never holds up an edge.
+                xQueueOverwrite(warm_queue, &warm);
+                warm_save_time = now;
+            }
+        } else {
+            radio_set(true, now);
         }
 
         // Check for button press.
@@ -403,8 +564,44 @@ void app_main() {
             } else if (message.input == RP2040_INPUT_BUTTON_BACK) {
                 // Disable the blinking if there is no SAO detected.
                 blink_enable = sao_detected;
+                if (!blink_enable) led_glow_set(false);
+            } else if (message.input == RP2040_INPUT_BUTTON_START) {
+                // Start or stop capturing received packets.
+                if (trace_active()) {
+                    trace_stop();
+                } else {
+                    trace_start(sync.randid);
+                }
+            } else if (message.input == RP2040_INPUT_BUTTON_SELECT) {
+                // Toggle the low-power mode.
+                xSemaphoreTake(mtx, portMAX_DELAY);
+                sync.low_power = !sync.low_power;
+                xSemaphoreGive(mtx);
+                if (sync.low_power) {
+                    // The statistics cover this stretch of low-power mode only.
+                    radio_set(radio_on, now);
+                    radio_on_time  = 0;
+                    low_power_time = now;
+                }
+            } else if (message.input == RP2040_INPUT_BUTTON_MENU) {
+                // Toggle the swarm clock mode.
+                xSemaphoreTake(mtx, portMAX_DELAY);
+                sync_set_clock_mode(&sync, now, !sync.clock_mode);
+                xSemaphoreGive(mtx);
+            } else if (message.input == RP2040_INPUT_JOYSTICK_PRESS) {
+                // Toggle the debug page, and log the statistics when opening it.
+                debug_page = !debug_page;
+                if (debug_page) {
+                    mem_stats_dump();
+                    i2c_sched_dump();
+                    espnow_tx_dump();
+                }
             }
-            draw_ui();
+            ui_mark_dirty();
+        }
+
+        if (!radio_on) {
+            low_power_sleep(now);
         }
     }
 }
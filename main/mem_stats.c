@@ -0,0 +1,104 @@
+#include "mem_stats.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+
+static const char* TAG = "mem";
+
+// Names of the MEM_HEAP_* values.
+char const* const mem_heap_names[MEM_HEAPS] = {"internal", "DMA", "PSRAM"};
+
+// Heap capability per MEM_HEAP_* value.
+static uint32_t const mem_heap_caps[MEM_HEAPS] = {MALLOC_CAP_INTERNAL, MALLOC_CAP_DMA, MALLOC_CAP_SPIRAM};
+
+// Registered fixed allocations.
+static mem_region_t mem_regions[MEM_MAX_REGIONS];
+// Number of entries in `mem_regions`; raised only after the entry is written.
+static volatile size_t mem_region_count = 0;
+
+typedef struct {
+    char const*  name;
+    TaskHandle_t task;
+    size_t       stack_size;
+} mem_task_entry_t;
+
+// Registered tasks.
+static mem_task_entry_t mem_tasks[MEM_MAX_TASKS];
+// Number of entries in `mem_tasks`; raised only after the entry is written.
+static volatile size_t mem_task_count = 0;
+
+// Registers a fixed allocation of `size` bytes; `name` must stay valid.
+void mem_stats_add_region(char const* name, size_t size) {
+    if (mem_region_count >= MEM_MAX_REGIONS) {
+        ESP_LOGW(TAG, "No room to track %s", name);
+        return;
+    }
+    mem_regions[mem_region_count] = (mem_region_t){.name = name, .size = size};
+    mem_region_count++;
+}
+
+// Registers a task with a stack of `stack_size` bytes, 0 if not known; `name` must stay valid.
+void mem_stats_add_task(char const* name, TaskHandle_t task, size_t stack_size) {
+    if (!task) return;
+    if (mem_task_count >= MEM_MAX_TASKS) {
+        ESP_LOGW(TAG, "No room to track task %s", name);
+        return;
+    }
+    mem_tasks[mem_task_count] = (mem_task_entry_t){.name = name, .task = task, .stack_size = stack_size};
+    mem_task_count++;
+}
+
+// Takes a snapshot of all memory use.
+void mem_stats_sample(mem_snapshot_t* snapshot) {
+    for (size_t i = 0; i < MEM_HEAPS; i++) {
+        mem_heap_t* heap = &snapshot->heaps[i];
+        heap->total      = heap_caps_get_total_size(mem_heap_caps[i]);
+        heap->free       = heap_caps_get_free_size(mem_heap_caps[i]);
+        heap->min_free   = heap_caps_get_minimum_free_size(mem_heap_caps[i]);
+        heap->largest    = heap_caps_get_largest_free_block(mem_heap_caps[i]);
+    }
+
+    snapshot->region_count = mem_region_count;
+    snapshot->region_total = 0;
+    for (size_t i = 0; i < snapshot->region_count; i++) {
+        snapshot->regions[i]    = mem_regions[i];
+        snapshot->region_total += mem_regions[i].size;
+    }
+
+    snapshot->task_count = mem_task_count;
+    for (size_t i = 0; i < snapshot->task_count; i++) {
+        // On this port the high-water mark is in bytes.
+        snapshot->tasks[i] = (mem_task_t){
+            .name       = mem_tasks[i].name,
+            .stack_size = mem_tasks[i].stack_size,
+            .stack_free = uxTaskGetStackHighWaterMark(mem_tasks[i].task),
+        };
+    }
+}
+
+// Logs a snapshot to the console.
+void mem_stats_dump() {
+    // Too big for the stack of the main task.
+    static mem_snapshot_t snapshot;
+    mem_stats_sample(&snapshot);
+
+    for (size_t i = 0; i < MEM_HEAPS; i++) {
+        mem_heap_t const* heap = &snapshot.heaps[i];
+        if (!heap->total) continue;
+        ESP_LOGI(TAG, "Heap %-8s %7u total %7u free %7u min free %7u largest block", mem_heap_names[i],
+            heap->total, heap->free, heap->min_free, heap->largest);
+    }
+    for (size_t i = 0; i < snapshot.region_count; i++) {
+        ESP_LOGI(TAG, "Fixed %-12s %7u", snapshot.regions[i].name, snapshot.regions[i].size);
+    }
+    ESP_LOGI(TAG, "Fixed total        %7u", snapshot.region_total);
+    for (size_t i = 0; i < snapshot.task_count; i++) {
+        mem_task_t const* task = &snapshot.tasks[i];
+        esp_log_level_t   level = task->stack_free < MEM_STACK_LOW ? ESP_LOG_WARN : ESP_LOG_INFO;
+        if (task->stack_size) {
+            ESP_LOG_LEVEL(level, TAG, "Stack %-8s %5u of %5u bytes never used", task->name, task->stack_free, task->stack_size);
+        } else {
+            ESP_LOG_LEVEL(level, TAG, "Stack %-8s %5u bytes never used", task->name, task->stack_free);
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#include "rx_filter.h"
+
+#include "firefly_sync.h"
+
+#include <string.h>
+
+// Marks a bucket as used.
+#define KEY_USED (1ULL << 63)
+
+// Thousandths of a token per packet.
+#define TOKEN 1000
+
+// Empties the filter.
+void rx_filter_init(rx_filter_t *filter, int64_t now) {
+    memset(filter, 0, sizeof(rx_filter_t));
+    filter->swarm.time       = now;
+    filter->swarm.credit     = RX_SWARM_BURST * TOKEN;
+    filter->newcomers.time   = now;
+    filter->newcomers.credit = RX_NEW_BURST * TOKEN;
+    filter->report_time      = now;
+}
+
+// Refills `bucket` up to `now` and takes a token if there is one.
+static bool bucket_take(rx_bucket_t *bucket, uint32_t now, int32_t rate, int32_t burst) {
+    uint32_t elapsed = now - bucket->time;
+    bucket->time     = now;
+    // Tokens per second times milliseconds is thousandths of a token.
+    if (elapsed > (uint32_t) burst * TOKEN / rate) {
+        bucket->credit = burst * TOKEN;
+    } else {
+        bucket->credit += elapsed * rate;
+        if (bucket->credit > burst * TOKEN) bucket->credit = burst * TOKEN;
+    }
+    if (bucket->credit < TOKEN) return false;
+    bucket->credit -= TOKEN;
+    return true;
+}
+
+// The set of buckets `key` may be in.
+static rx_bucket_t *bucket_set(rx_filter_t *filter, uint64_t key) {
+    // Mix all bits of the key into the low ones; MAC addresses often differ in the last byte only.
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return filter->buckets[key % RX_FILTER_SETS];
+}
+
+// Finds the bucket of `key`; NULL if there is none.
+static rx_bucket_t *bucket_find(rx_filter_t *filter, uint64_t key) {
+    rx_bucket_t *buckets = bucket_set(filter, key);
+    for (size_t i = 0; i < RX_FILTER_WAYS; i++) {
+        if (buckets[i].key == key) return &buckets[i];
+    }
+    return NULL;
+}
+
+// Makes a full bucket for `key` in place of the least recently used one of its set.
+static rx_bucket_t *bucket_add(rx_filter_t *filter, uint64_t key, uint32_t now) {
+    rx_bucket_t *buckets = bucket_set(filter, key);
+    rx_bucket_t *oldest  = &buckets[0];
+    for (size_t i = 1; i < RX_FILTER_WAYS && oldest->key; i++) {
+        if (!buckets[i].key || now - buckets[i].time > now - oldest->time) {
+            oldest = &buckets[i];
+        }
+    }
+    oldest->key    = key;
+    oldest->time   = now;
+    oldest->credit = RX_SENDER_BURST * TOKEN;
+    return oldest;
+}
+
+// Checks a packet from `mac` received at `now`; returns one of the RX_* verdicts.
+int rx_filter_check(rx_filter_t *filter, int64_t now, uint8_t const *mac, uint8_t const *data, size_t len) {
+    int verdict = RX_ACCEPT;
+    if (len < sizeof(packet_t)) {
+        verdict = RX_REJECT_SHORT;
+    } else if (memcmp(data, packet_magic, sizeof(packet_magic))) {
+        verdict = RX_REJECT_MAGIC;
+    } else {
+        uint32_t randid;
+        memcpy(&randid, data + offsetof(packet_t, randid), sizeof(randid));
+        // A sender is a MAC address and randid pair; a sender forging one of a peer's can forge both.
+        uint64_t key = KEY_USED | (uint64_t) randid << 16;
+        for (size_t i = 0; i < 6; i++) {
+            key ^= (uint64_t) mac[i] << (8 * i);
+        }
+
+        rx_bucket_t *bucket = bucket_find(filter, key);
+        if (!bucket) {
+            // New senders share one budget, so cycling MAC addresses or randids cannot evict known peers.
+            if (bucket_take(&filter->newcomers, now, RX_NEW_RATE, RX_NEW_BURST)) {
+                bucket = bucket_add(filter, key, now);
+            } else {
+                verdict = RX_REJECT_SWARM;
+            }
+        }
+        if (!bucket) {
+            // Already rejected.
+        } else if (!bucket_take(bucket, now, RX_SENDER_RATE, RX_SENDER_BURST)) {
+            verdict = RX_REJECT_SENDER;
+        } else if (!bucket_take(&filter->swarm, now, RX_SWARM_RATE, RX_SWARM_BURST)) {
+            verdict = RX_REJECT_SWARM;
+        }
+    }
+    filter->stats.count[verdict]++;
+    return verdict;
+}
+
+// At most once per RX_SUMMARY_INTERVAL, stores the counts since the previous summary in `delta`.
+// Returns true if any packets were rejected in that time.
+bool rx_filter_summary(rx_filter_t *filter, int64_t now, rx_filter_stats_t *delta) {
+    if (now < filter->report_time + RX_SUMMARY_INTERVAL) return false;
+    filter->report_time = now;
+
+    // The counters may move on while being copied; a packet is then reported next time.
+    rx_filter_stats_t stats = filter->stats;
+    bool              rejected = false;
+    for (size_t i = 0; i < RX_VERDICTS; i++) {
+        delta->count[i] = stats.count[i] - filter->reported.count[i];
+        if (i != RX_ACCEPT && delta->count[i]) rejected = true;
+    }
+    filter->reported = stats;
+    return rejected;
+}
@@ -1,5 +1,6 @@
 #include "sao_eeprom.h"
 
+#include <assert.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -7,6 +8,8 @@
 #include <stdio.h>
 #include <string.h>
 #include "eeprom.h"
+#include "i2c_eeprom.h"
+#include "sao_json.h"
 
 static const char* TAG = "SAO";
 
@@ -29,7 +32,7 @@ void dump_eeprom_contents(EEPROM* eeprom) {
 }
 
 void restore_first_byte_of_small_eeprom(char data) {
-    esp_err_t result = eeprom_write(&sao_eeprom_small, 0, (uint8_t*) &data, 1);
+    esp_err_t result = i2c_eeprom_write(&sao_eeprom_small, 0, (uint8_t*) &data, 1);
     if (result == ESP_OK) {
         // printf("Restored first byte of small EEPROM\n");
     } else {
@@ -37,6 +40,106 @@ void restore_first_byte_of_small_eeprom(char data) {
     }
 }
 
+// Makes a driver available as the first one of its type.
+static void sao_attach_driver(SAO* sao, sao_driver_t* driver) {
+    if (!sao->by_type[driver->type]) {
+        sao->by_type[driver->type] = driver;
+    }
+}
+
+static bool sao_parse_storage(sao_driver_t* driver) {
+    sao_driver_storage_data_t* data = &driver->storage;
+    return data->page_size_exp <= data->size_exp && data->size_exp <= 24 && (data->data_offset << data->page_size_exp) < (1 << data->size_exp);
+}
+
+static bool sao_parse_basic_io(sao_driver_t* driver) {
+    sao_driver_basic_io_data_t* data = &driver->basic_io;
+    if (data->io1_function > SAO_DRIVER_BASIC_IO_FUNC_LED_WHITE) data->io1_function = SAO_DRIVER_BASIC_IO_FUNC_NONE;
+    if (data->io2_function > SAO_DRIVER_BASIC_IO_FUNC_LED_WHITE) data->io2_function = SAO_DRIVER_BASIC_IO_FUNC_NONE;
+    return true;
+}
+
+static bool sao_parse_neopixel(sao_driver_t* driver) {
+    sao_driver_neopixel_data_t* data = &driver->neopixel;
+    return data->length > 0 && data->color_order < SAO_DRIVER_NEOPIXEL_COLOR_ORDER_MAX;
+}
+
+static bool sao_parse_ssd1306(sao_driver_t* driver) {
+    sao_driver_ssd1306_data_t* data = &driver->ssd1306;
+    return data->height == 32 || data->height == 64;
+}
+
+static bool sao_parse_ntag(sao_driver_t* driver) {
+    sao_driver_ntag_data_t* data = &driver->ntag;
+    return data->interrupt_pin <= 2;
+}
+
+static bool sao_parse_app(sao_driver_t* driver) {
+    // The slug must be null terminated.
+    if (driver->data_length >= SAO_MAX_FIELD_LENGTH) return false;
+    driver->data[driver->data_length] = 0;
+    return driver->data[0] != 0;
+}
+
+// Known drivers; must stay sorted by name for `sao_find_driver_handler`.
+static sao_driver_handler_t const sao_driver_handlers[] = {
+    {SAO_DRIVER_APP_NAME,      SAO_DRIVER_APP,      1,                                  sao_parse_app,      sao_attach_driver},
+    {SAO_DRIVER_BASIC_IO_NAME, SAO_DRIVER_BASIC_IO, sizeof(sao_driver_basic_io_data_t), sao_parse_basic_io, sao_attach_driver},
+    {SAO_DRIVER_FIREFLY_NAME,  SAO_DRIVER_FIREFLY,  sizeof(sao_driver_firefly_data_t),  NULL,               sao_attach_driver},
+    {SAO_DRIVER_NEOPIXEL_NAME, SAO_DRIVER_NEOPIXEL, sizeof(sao_driver_neopixel_data_t), sao_parse_neopixel, sao_attach_driver},
+    {SAO_DRIVER_NTAG_NAME,     SAO_DRIVER_NTAG,     sizeof(sao_driver_ntag_data_t),     sao_parse_ntag,     sao_attach_driver},
+    {SAO_DRIVER_SSD1306_NAME,  SAO_DRIVER_SSD1306,  sizeof(sao_driver_ssd1306_data_t),  sao_parse_ssd1306,  sao_attach_driver},
+    {SAO_DRIVER_STORAGE_NAME,  SAO_DRIVER_STORAGE,  sizeof(sao_driver_storage_data_t),  sao_parse_storage,  sao_attach_driver},
+};
+#define SAO_NUM_DRIVER_HANDLERS (sizeof(sao_driver_handlers) / sizeof(sao_driver_handler_t))
+_Static_assert(SAO_NUM_DRIVER_HANDLERS == SAO_DRIVER_TYPE_MAX - 1, "Every driver type needs a handler");
+
+// Look up the handler for a driver name, or NULL if it is not known.
+sao_driver_handler_t const* sao_find_driver_handler(char const* name) {
+#ifndef NDEBUG
+    // A misplaced entry would make the search below miss drivers without a word; checked once.
+    static bool sorted = false;
+    for (size_t i = 1; !sorted && i < SAO_NUM_DRIVER_HANDLERS; i++) {
+        assert(strcmp(sao_driver_handlers[i - 1].name, sao_driver_handlers[i].name) < 0);
+    }
+    sorted = true;
+#endif
+
+    size_t lo = 0, hi = SAO_NUM_DRIVER_HANDLERS;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int    cmp = strcmp(name, sao_driver_handlers[mid].name);
+        if (cmp == 0) return &sao_driver_handlers[mid];
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+// Validate, parse and attach one driver read from the SAO descriptor.
+// Unknown or invalid drivers are kept with type `SAO_DRIVER_UNKNOWN`.
+void sao_dispatch_driver(SAO* sao, sao_driver_t* driver) {
+    driver->type = SAO_DRIVER_UNKNOWN;
+    sao_driver_handler_t const* handler = sao_find_driver_handler(driver->name);
+    if (!handler) {
+        // ESP_LOGD(TAG, "Unknown driver \"%s\"", driver->name);
+        return;
+    }
+    if (driver->data_length < handler->data_length) {
+        // ESP_LOGW(TAG, "Driver \"%s\" has %u bytes of data, expected %u", driver->name, driver->data_length, handler->data_length);
+        return;
+    }
+    if (handler->parse && !handler->parse(driver)) {
+        // ESP_LOGW(TAG, "Driver \"%s\" has invalid data", driver->name);
+        return;
+    }
+    driver->type = handler->type;
+    handler->attach(sao, driver);
+}
+
 esp_err_t sao_identify_binary(SAO* sao, EEPROM* eeprom, sao_binary_header_t* header) {
     // https://badge.a-combinator.com/addons/addon-id/
 
@@ -55,7 +158,7 @@ esp_err_t sao_identify_binary(SAO* sao, EEPROM* eeprom, sao_binary_header_t* hea
     uint8_t  name_length = header->name_length;
     uint32_t position    = sizeof(sao_binary_header_t);
 
-    if (eeprom_read(eeprom, position, (uint8_t*) sao->name, name_length) != ESP_OK) {
+    if (i2c_eeprom_read(eeprom, position, (uint8_t*) sao->name, name_length) != ESP_OK) {
         // ESP_LOGE(TAG, "Failed to read SAO name");
         return ESP_FAIL;
     }
@@ -79,12 +182,12 @@ esp_err_t sao_identify_binary(SAO* sao, EEPROM* eeprom, sao_binary_header_t* hea
     uint8_t driver_data_length = header->driver_data_length;
 
     for (uint8_t driver_index = 0; driver_index < sao->amount_of_drivers; driver_index++) {
-        if (eeprom_read(eeprom, position, (uint8_t*) sao->drivers[driver_index].name, driver_name_length) != ESP_OK) {
+        if (i2c_eeprom_read(eeprom, position, (uint8_t*) sao->drivers[driver_index].name, driver_name_length) != ESP_OK) {
             // ESP_LOGE(TAG, "Failed to read SAO driver name");
             return ESP_FAIL;
         }
         position += driver_name_length;
-        if (eeprom_read(eeprom, position, (uint8_t*) sao->drivers[driver_index].data, driver_data_length) != ESP_OK) {
+        if (i2c_eeprom_read(eeprom, position, (uint8_t*) sao->drivers[driver_index].data, driver_data_length) != ESP_OK) {
             // ESP_LOGE(TAG, "Failed to read SAO driver data");
             return ESP_FAIL;
         }
@@ -95,10 +198,11 @@ esp_err_t sao_identify_binary(SAO* sao, EEPROM* eeprom, sao_binary_header_t* hea
             if (sao->drivers[driver_index].name[i] < ' ' && sao->drivers[driver_index].name[i] > '\0') sao->drivers[driver_index].name[i] = '?';
             if (sao->drivers[driver_index].name[i] > '~') sao->drivers[driver_index].name[i] = '?';
         }
+        sao_dispatch_driver(sao, &sao->drivers[driver_index]);
 
         if (driver_index < sao->amount_of_drivers - 1) {
             sao_binary_extra_driver_t extra_header;
-            if (eeprom_read(eeprom, position, (uint8_t*) &extra_header, sizeof(sao_binary_extra_driver_t)) != ESP_OK) {
+            if (i2c_eeprom_read(eeprom, position, (uint8_t*) &extra_header, sizeof(sao_binary_extra_driver_t)) != ESP_OK) {
                 // ESP_LOGE(TAG, "Failed to read SAO extra driver header");
                 return ESP_FAIL;
             }
@@ -127,7 +231,7 @@ esp_err_t sao_identify(SAO* sao) {
     sao_binary_header_t header;
     // ESP_LOGI(TAG, "Identifying SAO (small EEPROM)...");
     dump_eeprom_contents(&sao_eeprom_small);
-    esp_err_t result = eeprom_read(&sao_eeprom_small, 0, (uint8_t*) &header, sizeof(header));
+    esp_err_t result = i2c_eeprom_read(&sao_eeprom_small, 0, (uint8_t*) &header, sizeof(header));
     if (result != ESP_OK) {
         return ESP_OK;
     }
@@ -137,11 +241,11 @@ esp_err_t sao_identify(SAO* sao) {
     } else if (memcmp(&header.magic[1], "SON", 3) == 0) {
         // https://badge.a-combinator.com/addons/addon-id/
         // ESP_LOGI(TAG, "SAO with JSON descriptor on small EEPROM detected");
-        sao->type = SAO_JSON;
+        return sao_identify_json(sao, &sao_eeprom_small);
     } else {
         // ESP_LOGI(TAG, "Identifying SAO (big EEPROM)...");
         dump_eeprom_contents(&sao_eeprom_big);
-        esp_err_t result = eeprom_read(&sao_eeprom_big, 0, (uint8_t*) &header, sizeof(header));
+        esp_err_t result = i2c_eeprom_read(&sao_eeprom_big, 0, (uint8_t*) &header, sizeof(header));
         if (result != ESP_OK) {
             return ESP_OK;
         }
@@ -151,7 +255,7 @@ esp_err_t sao_identify(SAO* sao) {
         } else if (memcmp(&header.magic[1], "SON", 3) == 0) {
             // https://badge.a-combinator.com/addons/addon-id/
             // ESP_LOGI(TAG, "SAO with JSON descriptor on big EEPROM detected");
-            sao->type = SAO_JSON;
+            return sao_identify_json(sao, &sao_eeprom_big);
         } else {
             // ESP_LOGI(TAG, "Unformatted SAO or SAO with unsupported formatting detected");
             sao->type = SAO_UNFORMATTED;
@@ -209,11 +313,11 @@ esp_err_t sao_format_old(const char* name, const char* driver, const uint8_t* dr
     }
 
     if (small) {
-        printf("Writing %u bytes to small EEPROM\n", position);
-        return eeprom_write(&sao_eeprom_small, 0, data, position);
+        printf("Writing %zu bytes to small EEPROM\n", position);
+        return i2c_eeprom_write(&sao_eeprom_small, 0, data, position);
     } else {
-        printf("Writing %u bytes to big EEPROM\n", position);
-        return eeprom_write(&sao_eeprom_big, 0, data, position);
+        printf("Writing %zu bytes to big EEPROM\n", position);
+        return i2c_eeprom_write(&sao_eeprom_big, 0, data, position);
     }
 }
 
@@ -248,7 +352,7 @@ esp_err_t sao_format(char const *name, size_t eeprom_size, size_t eeprom_page_si
     };
     
     // Write to the device.
-    ec = eeprom_write(&sao_eeprom, 0x50, buf, buf_len);
+    ec = i2c_eeprom_write(&sao_eeprom, 0x50, buf, buf_len);
     free(buf);
     return ec;
 }
@@ -346,5 +450,7 @@ esp_err_t sao_format_data(char const *name, size_t eeprom_size, size_t eeprom_pa
     }
     
     // Fin.
+    *out_buf_ptr = buf;
+    *out_size    = buf_len;
     return 0;
 }
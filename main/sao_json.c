@@ -0,0 +1,300 @@
+#include "sao_json.h"
+
+#include "i2c_eeprom.h"
+
+#include <esp_log.h>
+#include <string.h>
+
+static const char* TAG = "SAO JSON";
+
+// Length of the "JSON" magic.
+#define SAO_JSON_MAGIC_LENGTH 4
+
+typedef struct {
+    EEPROM*  eeprom;
+    // EEPROM address of the next chunk.
+    uint32_t offset;
+    // Current chunk.
+    uint8_t  chunk[SAO_JSON_CHUNK];
+    uint8_t  pos;
+    uint8_t  len;
+    // Current character, or -1 at the end of the descriptor.
+    int      peek;
+} json_reader_t;
+
+// Reads the next chunk, up to the end of the current EEPROM page.
+static void json_fill(json_reader_t* r) {
+    r->pos = 0;
+    r->len = 0;
+    if (r->offset >= SAO_JSON_MAX_LENGTH) return;
+
+    size_t page = r->eeprom->page_size;
+    if (!page || page > SAO_JSON_CHUNK) page = SAO_JSON_CHUNK;
+    size_t len = page - r->offset % page;
+    if (r->offset + len > SAO_JSON_MAX_LENGTH) len = SAO_JSON_MAX_LENGTH - r->offset;
+
+    if (i2c_eeprom_read(r->eeprom, r->offset, r->chunk, len) != ESP_OK) {
+        ESP_LOGD(TAG, "Read failed at %u", r->offset);
+        return;
+    }
+    r->offset += len;
+    r->len     = len;
+}
+
+// Moves to the next character.
+static void json_advance(json_reader_t* r) {
+    if (r->peek < 0) return;
+    if (r->pos >= r->len) {
+        json_fill(r);
+        if (!r->len) {
+            r->peek = -1;
+            return;
+        }
+    }
+    uint8_t c = r->chunk[r->pos++];
+    // A NUL byte or erased EEPROM ends the descriptor.
+    r->peek = (c == 0 || c == 0xff) ? -1 : c;
+}
+
+// Skips whitespace and returns the current character.
+static int json_ws(json_reader_t* r) {
+    while (r->peek == ' ' || r->peek == '\t' || r->peek == '\r' || r->peek == '\n') {
+        json_advance(r);
+    }
+    return r->peek;
+}
+
+// Consumes `c` after optional whitespace.
+static bool json_expect(json_reader_t* r, char c) {
+    if (json_ws(r) != c) return false;
+    json_advance(r);
+    return true;
+}
+
+// Consumes a ',' and returns true if another element follows,
+// or consumes `close` and returns false with `*ok` set.
+static bool json_next(json_reader_t* r, char close, bool* ok) {
+    if (json_ws(r) == ',') {
+        json_advance(r);
+        return true;
+    }
+    *ok = json_expect(r, close);
+    return false;
+}
+
+// Reads a string into `out`, truncating to `cap - 1` bytes.
+// If `out` is NULL, the string is skipped.
+static bool json_string(json_reader_t* r, char* out, size_t cap, size_t* len) {
+    if (!json_expect(r, '"')) return false;
+    size_t n = 0;
+    while (1) {
+        int c = r->peek;
+        if (c < 0) return false;
+        json_advance(r);
+        if (c == '"') break;
+
+        if (c == '\\') {
+            c = r->peek;
+            if (c < 0) return false;
+            json_advance(r);
+            switch (c) {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    // Only ASCII is kept; anything else becomes '?'.
+                    int value = 0;
+                    for (int i = 0; i < 4; i++) {
+                        int h = r->peek;
+                        if (h >= '0' && h <= '9') value = value * 16 + h - '0';
+                        else if (h >= 'a' && h <= 'f') value = value * 16 + h - 'a' + 10;
+                        else if (h >= 'A' && h <= 'F') value = value * 16 + h - 'A' + 10;
+                        else return false;
+                        json_advance(r);
+                    }
+                    c = value < 0x80 ? value : '?';
+                } break;
+                default: break;
+            }
+        }
+        if (out && n + 1 < cap) out[n++] = c;
+    }
+    if (out) out[n] = 0;
+    if (len) *len = n;
+    return true;
+}
+
+// Reads an integer; fractions and exponents are ignored.
+static bool json_number(json_reader_t* r, int32_t* out) {
+    int  c        = json_ws(r);
+    bool negative = c == '-';
+    if (negative) {
+        json_advance(r);
+        c = r->peek;
+    }
+    if (c < '0' || c > '9') return false;
+
+    int32_t value = 0;
+    while (c >= '0' && c <= '9') {
+        if (value < 100000000) value = value * 10 + c - '0';
+        json_advance(r);
+        c = r->peek;
+    }
+    while (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-' || (c >= '0' && c <= '9')) {
+        json_advance(r);
+        c = r->peek;
+    }
+    *out = negative ? -value : value;
+    return true;
+}
+
+// Skips any value, nested at most SAO_JSON_MAX_DEPTH deep.
+static bool json_skip(json_reader_t* r, int depth) {
+    if (depth >= SAO_JSON_MAX_DEPTH) return false;
+    int c = json_ws(r);
+
+    if (c == '"') {
+        return json_string(r, NULL, 0, NULL);
+
+    } else if (c == '{' || c == '[') {
+        char close = c == '{' ? '}' : ']';
+        json_advance(r);
+        if (json_ws(r) == close) {
+            json_advance(r);
+            return true;
+        }
+        bool ok = false;
+        do {
+            if (close == '}' && (!json_string(r, NULL, 0, NULL) || !json_expect(r, ':'))) return false;
+            if (!json_skip(r, depth + 1)) return false;
+        } while (json_next(r, close, &ok));
+        return ok;
+
+    } else if (c < 0 || c == ',' || c == '}' || c == ']' || c == ':') {
+        return false;
+    }
+
+    // Number, true, false or null.
+    while (c >= 0 && c != ',' && c != '}' && c != ']' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        json_advance(r);
+        c = r->peek;
+    }
+    return true;
+}
+
+// Reads driver data: an array of bytes or a string.
+static bool json_driver_data(json_reader_t* r, sao_driver_t* driver) {
+    if (json_ws(r) == '"') {
+        size_t len;
+        if (!json_string(r, (char*) driver->data, SAO_MAX_FIELD_LENGTH, &len)) return false;
+        driver->data_length = len;
+        return true;
+    }
+
+    if (!json_expect(r, '[')) return false;
+    driver->data_length = 0;
+    if (json_ws(r) == ']') {
+        json_advance(r);
+        return true;
+    }
+    bool ok = false;
+    do {
+        int32_t value;
+        if (!json_number(r, &value) || value < 0 || value > 255) return false;
+        if (driver->data_length < SAO_MAX_FIELD_LENGTH) driver->data[driver->data_length++] = value;
+    } while (json_next(r, ']', &ok));
+    return ok;
+}
+
+// Reads one driver object.
+static bool json_driver(json_reader_t* r, sao_driver_t* driver) {
+    if (!json_expect(r, '{')) return false;
+    if (json_ws(r) == '}') {
+        json_advance(r);
+        return true;
+    }
+    bool ok = false;
+    do {
+        char key[16];
+        if (!json_string(r, key, sizeof(key), NULL) || !json_expect(r, ':')) return false;
+        bool value_ok;
+        if (!strcmp(key, "name")) {
+            value_ok = json_string(r, driver->name, sizeof(driver->name), NULL);
+        } else if (!strcmp(key, "data")) {
+            value_ok = json_driver_data(r, driver);
+        } else {
+            value_ok = json_skip(r, 3);
+        }
+        if (!value_ok) return false;
+    } while (json_next(r, '}', &ok));
+    return ok;
+}
+
+// Replaces unprintable characters like the binary parser does.
+static void json_sanitise(char* str) {
+    for (; *str; str++) {
+        if (*str < ' ' || *str > '~') *str = '?';
+    }
+}
+
+// Reads the drivers array.
+static bool json_drivers(json_reader_t* r, SAO* sao) {
+    if (!json_expect(r, '[')) return false;
+    if (json_ws(r) == ']') {
+        json_advance(r);
+        return true;
+    }
+    bool ok = false;
+    do {
+        if (sao->amount_of_drivers >= SAO_MAX_NUM_DRIVERS) {
+            // Scan at most SAO_MAX_NUM_DRIVERS driver definitions.
+            if (!json_skip(r, 2)) return false;
+            continue;
+        }
+        sao_driver_t* driver = &sao->drivers[sao->amount_of_drivers];
+        if (!json_driver(r, driver)) return false;
+        json_sanitise(driver->name);
+        sao_dispatch_driver(sao, driver);
+        sao->amount_of_drivers++;
+    } while (json_next(r, ']', &ok));
+    return ok;
+}
+
+// Parse a JSON descriptor from `eeprom` into `sao`.
+// Reads page-sized chunks and uses no heap; drivers are dispatched like binary ones.
+esp_err_t sao_identify_json(SAO* sao, EEPROM* eeprom) {
+    memset(sao, 0, sizeof(SAO));
+    sao->type = SAO_JSON;
+
+    json_reader_t r = {
+        .eeprom = eeprom,
+        .offset = SAO_JSON_MAGIC_LENGTH,
+        .peek   = ' ',
+    };
+    json_advance(&r);
+
+    if (!json_expect(&r, '{')) return ESP_FAIL;
+    if (json_ws(&r) == '}') return ESP_OK;
+    bool ok = false;
+    do {
+        char key[16];
+        if (!json_string(&r, key, sizeof(key), NULL) || !json_expect(&r, ':')) return ESP_FAIL;
+        bool value_ok;
+        if (!strcmp(key, "name")) {
+            value_ok = json_string(&r, sao->name, sizeof(sao->name), NULL);
+            json_sanitise(sao->name);
+        } else if (!strcmp(key, "drivers")) {
+            value_ok = json_drivers(&r, sao);
+        } else {
+            value_ok = json_skip(&r, 1);
+        }
+        if (!value_ok) {
+            ESP_LOGD(TAG, "Syntax error near %u", r.offset - r.len + r.pos);
+            return ESP_FAIL;
+        }
+    } while (json_next(&r, '}', &ok));
+
+    return ok ? ESP_OK : ESP_FAIL;
+}
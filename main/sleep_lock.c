@@ -0,0 +1,49 @@
+#include "sleep_lock.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Locks held.
+static int sleep_lock_count = 0;
+// Is the main task going to sleep or asleep?
+static bool sleep_lock_sleeping = false;
+// Guards both.
+static portMUX_TYPE sleep_lock_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Holds off light sleep until the matching sleep_lock_release; waits while the main task sleeps.
+void sleep_lock_acquire() {
+    while (1) {
+        portENTER_CRITICAL(&sleep_lock_mux);
+        if (!sleep_lock_sleeping) {
+            sleep_lock_count++;
+            portEXIT_CRITICAL(&sleep_lock_mux);
+            return;
+        }
+        portEXIT_CRITICAL(&sleep_lock_mux);
+        // The sleep stalls this core; the delay ends after waking up.
+        vTaskDelay(1);
+    }
+}
+
+// Releases a lock taken with sleep_lock_acquire.
+void sleep_lock_release() {
+    portENTER_CRITICAL(&sleep_lock_mux);
+    sleep_lock_count--;
+    portEXIT_CRITICAL(&sleep_lock_mux);
+}
+
+// For the main task: true if no lock is held, after which locks wait until sleep_lock_wake.
+bool sleep_lock_try_sleep() {
+    portENTER_CRITICAL(&sleep_lock_mux);
+    sleep_lock_sleeping = sleep_lock_count == 0;
+    bool sleeping       = sleep_lock_sleeping;
+    portEXIT_CRITICAL(&sleep_lock_mux);
+    return sleeping;
+}
+
+// For the main task: lets locks be taken again after sleeping.
+void sleep_lock_wake() {
+    portENTER_CRITICAL(&sleep_lock_mux);
+    sleep_lock_sleeping = false;
+    portEXIT_CRITICAL(&sleep_lock_mux);
+}
@@ -0,0 +1,191 @@
+#include "trace.h"
+
+#include "mem_stats.h"
+#include "sleep_lock.h"
+#include "task_core.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_vfs_fat.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/stream_buffer.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "trace";
+
+// Stack size of the writer task; holds one TRACE_WRITE_CHUNK.
+#define TRACE_TASK_STACK 3072
+// Bytes moved from the buffer to the output at a time.
+#define TRACE_WRITE_CHUNK 256
+
+// Records waiting to be written.
+static StreamBufferHandle_t trace_buffer;
+// The writer task.
+static TaskHandle_t trace_task_handle;
+// Output file, when not streaming over serial.
+static FILE *trace_file;
+// Is a capture running?
+static volatile bool trace_running = false;
+// Is the writer task busy with a capture, including draining it after a stop?
+static volatile bool trace_writing = false;
+// Records dropped because the buffer was full.
+static volatile uint32_t trace_drop_count = 0;
+// Number of captures started, for unique file names.
+static uint32_t trace_count = 0;
+
+// Writes raw trace bytes to the output.
+static void trace_output(uint8_t const *data, size_t len) {
+    if (TRACE_TO_SERIAL) {
+        // Hex lines, so the trace can be picked out of the console log.
+        printf(TRACE_SERIAL_PREFIX);
+        for (size_t i = 0; i < len; i++) {
+            printf("%02x", data[i]);
+        }
+        printf("\n");
+    } else if (trace_file) {
+        fwrite(data, 1, len, trace_file);
+    }
+}
+
+// Moves records from the buffer to the output.
+static void trace_task(void *arg) {
+    uint8_t chunk[TRACE_WRITE_CHUNK];
+    while (1) {
+        // Wait for a capture to start.
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        int64_t last_flush = esp_timer_get_time() / 1000;
+        size_t  len;
+        do {
+            len = xStreamBufferReceive(trace_buffer, chunk, sizeof(chunk), pdMS_TO_TICKS(TRACE_FLUSH_INTERVAL));
+            int64_t now   = esp_timer_get_time() / 1000;
+            bool    flush = trace_file && now > last_flush + TRACE_FLUSH_INTERVAL;
+            if (!len && !flush) continue;
+
+            sleep_lock_acquire();
+            if (len) trace_output(chunk, len);
+            if (flush) {
+                fflush(trace_file);
+                last_flush = now;
+            }
+            sleep_lock_release();
+        } while (trace_running || len);
+
+        // Drained after stopping.
+        sleep_lock_acquire();
+        if (trace_file) fclose(trace_file);
+        sleep_lock_release();
+        trace_file    = NULL;
+        trace_writing = false;
+    }
+}
+
+// Mounts the FAT partition, once.
+static bool trace_mount() {
+    static bool mounted = false;
+    if (mounted) return true;
+
+    esp_vfs_fat_mount_config_t config = {
+        .format_if_mount_failed = false,
+        .max_files              = 2,
+        .allocation_unit_size   = 0,
+    };
+    static wl_handle_t wl_handle;
+    esp_err_t ec = esp_vfs_fat_spiflash_mount(TRACE_MOUNT_POINT, "locfd", &config, &wl_handle);
+    if (ec) {
+        ESP_LOGE(TAG, "Failed to mount FAT: %s", esp_err_to_name(ec));
+        return false;
+    }
+    mounted = true;
+    return true;
+}
+
+// Starts capturing into a new trace.
+bool trace_start(uint32_t randid) {
+    if (trace_running) return true;
+    // The previous capture is still being written out.
+    if (trace_writing) {
+        ESP_LOGW(TAG, "Previous capture is still being written");
+        return false;
+    }
+
+    if (!trace_buffer) {
+        trace_buffer = xStreamBufferCreate(TRACE_BUFFER_SIZE, 1);
+        if (!trace_buffer) return false;
+        mem_stats_add_region("trace buffer", TRACE_BUFFER_SIZE);
+    }
+    if (!trace_task_handle) {
+        if (xTaskCreatePinnedToCore(trace_task, "trace", TRACE_TASK_STACK, NULL, 1, &trace_task_handle, HELPER_TASK_CORE) != pdPASS) {
+            return false;
+        }
+        mem_stats_add_task("trace", trace_task_handle, TRACE_TASK_STACK);
+    }
+
+    // The writer is idle, so nothing waits on the buffer and the reset cannot fail;
+    // checked anyway, as leftover bytes would corrupt the new trace.
+    if (xStreamBufferReset(trace_buffer) != pdPASS) return false;
+
+    if (!TRACE_TO_SERIAL) {
+        if (!trace_mount()) return false;
+        char path[48];
+        snprintf(path, sizeof(path), TRACE_MOUNT_POINT "/ff%08x_%u.bin", randid, trace_count++);
+        trace_file = fopen(path, "wb");
+        if (!trace_file) {
+            ESP_LOGE(TAG, "Failed to open %s", path);
+            return false;
+        }
+        ESP_LOGI(TAG, "Capturing to %s", path);
+    }
+
+    // The header goes through the buffer too; nothing else writes to it yet.
+    trace_header_t header = {
+        .magic   = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .randid  = randid,
+    };
+    xStreamBufferSend(trace_buffer, &header, sizeof(header), 0);
+    trace_drop_count = 0;
+    trace_writing    = true;
+    trace_running    = true;
+    xTaskNotifyGive(trace_task_handle);
+    return true;
+}
+
+// Stops capturing and closes the trace.
+void trace_stop() {
+    if (!trace_running) return;
+    trace_running = false;
+    ESP_LOGI(TAG, "Capture stopped, %u records dropped", trace_drop_count);
+}
+
+// Whether a capture is running.
+bool trace_active() {
+    return trace_running;
+}
+
+// Records a received packet; safe to call from the WiFi task, never blocks.
+void trace_record(int64_t now, uint8_t const *mac, int8_t rssi, uint8_t const *data, size_t len) {
+    if (!trace_running) return;
+    if (len > 255) len = 255;
+
+    uint8_t         record[sizeof(trace_record_t) + 255];
+    trace_record_t *header = (trace_record_t *) record;
+    header->time = now;
+    memcpy(header->mac, mac, sizeof(header->mac));
+    header->rssi = rssi;
+    header->len  = len;
+    memcpy(record + sizeof(trace_record_t), data, len);
+
+    // Whole records only, so the trace stays parseable when the buffer fills up.
+    size_t total = sizeof(trace_record_t) + len;
+    if (xStreamBufferSpacesAvailable(trace_buffer) < total || xStreamBufferSend(trace_buffer, record, total, 0) != total) {
+        trace_drop_count++;
+    }
+}
+
+// Number of records dropped because the buffer was full.
+uint32_t trace_dropped() {
+    return trace_drop_count;
+}
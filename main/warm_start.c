@@ -0,0 +1,83 @@
+#include "warm_start.h"
+
+#include <esp_log.h>
+#include <nvs.h>
+#include <string.h>
+#include "kvlog.h"
+
+static const char* TAG = "warm";
+
+// NVS namespace and key used when there is no SAO storage.
+#define WARM_NVS_NAMESPACE "firefly"
+#define WARM_NVS_KEY       "warm"
+
+// Log in the SAO storage region.
+static kvlog_t warm_log;
+// Is `warm_log` open?
+static bool warm_log_open = false;
+// Storage driver data `warm_log` was opened with.
+static sao_driver_storage_data_t warm_log_storage;
+
+// Selects where the state is kept: the storage region of `sao` if it has one,
+// otherwise NVS. Cheap to call again; only reopens if the storage changed.
+void warm_start_open(SAO const* sao) {
+    sao_driver_t const* driver = sao ? sao->by_type[SAO_DRIVER_STORAGE] : NULL;
+    if (!driver) {
+        warm_log_open = false;
+        return;
+    }
+    if (warm_log_open && !memcmp(&warm_log_storage, &driver->storage, sizeof(warm_log_storage))) {
+        return;
+    }
+
+    sao_driver_storage_data_t const* storage = &driver->storage;
+    uint32_t size   = 1 << storage->size_exp;
+    EEPROM   eeprom = {
+          .i2c_bus       = 0,
+          .i2c_address   = storage->address,
+          .address_16bit = size > 256,
+          .page_size     = 1 << storage->page_size_exp,
+    };
+    uint32_t start = storage->data_offset << storage->page_size_exp;
+
+    esp_err_t ec = kvlog_open(&warm_log, &eeprom, start, size - start);
+    if (ec) {
+        ESP_LOGW(TAG, "SAO storage unusable (%s), using NVS", esp_err_to_name(ec));
+        warm_log_open = false;
+        return;
+    }
+    warm_log_storage = *storage;
+    warm_log_open    = true;
+}
+
+// Loads the saved state; returns false if there is none.
+bool warm_start_load(warm_state_t* state) {
+    if (warm_log_open) {
+        return kvlog_get(&warm_log, WARM_KEY_ON_DURATION, &state->led_on_duration, sizeof(state->led_on_duration))
+            && kvlog_get(&warm_log, WARM_KEY_OFF_DURATION, &state->led_off_duration, sizeof(state->led_off_duration));
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(WARM_NVS_NAMESPACE, NVS_READONLY, &handle)) return false;
+    size_t    len = sizeof(warm_state_t);
+    esp_err_t ec  = nvs_get_blob(handle, WARM_NVS_KEY, state, &len);
+    nvs_close(handle);
+    return !ec && len == sizeof(warm_state_t);
+}
+
+// Saves the state.
+esp_err_t warm_start_save(warm_state_t const* state) {
+    if (warm_log_open) {
+        kvlog_set(&warm_log, WARM_KEY_ON_DURATION, &state->led_on_duration, sizeof(state->led_on_duration));
+        kvlog_set(&warm_log, WARM_KEY_OFF_DURATION, &state->led_off_duration, sizeof(state->led_off_duration));
+        return kvlog_commit(&warm_log);
+    }
+
+    nvs_handle_t handle;
+    esp_err_t    ec = nvs_open(WARM_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ec) return ec;
+    ec = nvs_set_blob(handle, WARM_NVS_KEY, state, sizeof(warm_state_t));
+    if (!ec) ec = nvs_commit(handle);
+    nvs_close(handle);
+    return ec;
+}
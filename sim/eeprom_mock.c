@@ -0,0 +1,54 @@
+// Simulated SAO EEPROM with transaction counters and an I2C timing model.
+
+#include "eeprom_mock.h"
+
+#include <string.h>
+
+uint8_t             mock_eeprom[MOCK_EEPROM_SIZE];
+uint32_t            mock_eeprom_wear[MOCK_EEPROM_SIZE / MOCK_EEPROM_PAGE_SIZE];
+mock_eeprom_stats_t mock_eeprom_stats;
+
+// Erases the EEPROM (all 0xff) and resets the counters and wear.
+void mock_eeprom_erase() {
+    memset(mock_eeprom, 0xff, sizeof(mock_eeprom));
+    memset(mock_eeprom_wear, 0, sizeof(mock_eeprom_wear));
+    memset(&mock_eeprom_stats, 0, sizeof(mock_eeprom_stats));
+}
+
+esp_err_t eeprom_read(EEPROM* device, uint16_t address, uint8_t* buffer, size_t length) {
+    // Address byte(s), repeated start, then the data; 9 bits per byte.
+    mock_eeprom_stats.reads++;
+    mock_eeprom_stats.bytes_read += length;
+    mock_eeprom_stats.bus_us     += MOCK_I2C_BIT_US * (9 * (2 + device->address_16bit + 1 + length) + 2);
+
+    if (!device->address_16bit) {
+        // The simulated part needs 16-bit addresses; a single address byte reads garbage.
+        memset(buffer, 0xff, length);
+        return ESP_OK;
+    }
+    if (address + length > MOCK_EEPROM_SIZE) return ESP_FAIL;
+    memcpy(buffer, mock_eeprom + address, length);
+    return ESP_OK;
+}
+
+esp_err_t eeprom_write(EEPROM* device, uint16_t address, uint8_t* buffer, size_t length) {
+    if (!device->address_16bit || address + length > MOCK_EEPROM_SIZE) return ESP_FAIL;
+
+    // Writes are split at page boundaries like the real driver does.
+    while (length) {
+        size_t chunk = MOCK_EEPROM_PAGE_SIZE - address % MOCK_EEPROM_PAGE_SIZE;
+        if (chunk > length) chunk = length;
+        memcpy(mock_eeprom + address, buffer, chunk);
+
+        mock_eeprom_stats.writes++;
+        mock_eeprom_stats.page_writes++;
+        mock_eeprom_stats.bytes_written += chunk;
+        mock_eeprom_stats.bus_us        += MOCK_I2C_BIT_US * (9 * (3 + chunk) + 2) + MOCK_EEPROM_WRITE_US;
+        mock_eeprom_wear[address / MOCK_EEPROM_PAGE_SIZE]++;
+
+        address += chunk;
+        buffer  += chunk;
+        length  -= chunk;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,35 @@
+// Simulated SAO EEPROM with transaction counters and an I2C timing model.
+
+#pragma once
+
+#include "eeprom.h"
+
+// Size of the simulated EEPROM (a 16 KiB part like on the firefly SAO).
+#define MOCK_EEPROM_SIZE      16384
+// Page size of the simulated EEPROM.
+#define MOCK_EEPROM_PAGE_SIZE 64
+// I2C bit time in microseconds (400 kHz).
+#define MOCK_I2C_BIT_US       2.5
+// Internal write cycle time per page in microseconds.
+#define MOCK_EEPROM_WRITE_US  5000
+
+typedef struct {
+    // Read and write transactions.
+    uint32_t reads, writes;
+    // Payload bytes transferred.
+    uint32_t bytes_read, bytes_written;
+    // EEPROM pages programmed; each costs a write cycle and wears the page.
+    uint32_t page_writes;
+    // Modelled bus and write cycle time in microseconds.
+    double   bus_us;
+} mock_eeprom_stats_t;
+
+// Contents of the simulated EEPROM.
+extern uint8_t mock_eeprom[MOCK_EEPROM_SIZE];
+// Number of times each page was programmed.
+extern uint32_t mock_eeprom_wear[MOCK_EEPROM_SIZE / MOCK_EEPROM_PAGE_SIZE];
+// Counters since the last reset.
+extern mock_eeprom_stats_t mock_eeprom_stats;
+
+// Erases the EEPROM (all 0xff) and resets the counters and wear.
+void mock_eeprom_erase();
@@ -0,0 +1,463 @@
+// Firefly swarm simulator.
+// Runs a swarm of badges with the real sync logic from main/ on a shared broadcast channel,
+// and compares synchronisation quality, energy use and packet delivery between the always-on and
+// low-power modes, each with the period following the peers once per cycle or on every packet,
+// edges announced right away or after a backoff, and the swarm clock mode.
+
+#include "esp_system.h"
+#include "firefly_sync.h"
+#include "trace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Probability of hearing packet in perect.
+#define PACKET_HEARD_PERCENT 100
+// Badges boot at a random time in the first this many milliseconds.
+#define BOOT_SPREAD 30000
+// ON edges closer together than this belong to the same flash.
+#define FLASH_GAP 1000
+// Crystal tolerance: local clocks run up to this many parts per million fast or slow.
+#define CLOCK_DRIFT_PPM 20
+
+// Channel model: all badges share one channel and contend for it like 802.11 DCF.
+// The sender with the shortest random backoff goes first; senders that pick the same
+// backoff collide, and broadcasts are never retried.
+// Airtime of one ESP-NOW broadcast at 1 Mbit/s, preamble included, in microseconds.
+#define AIR_PACKET_US 550
+// Backoff slot in microseconds.
+#define AIR_SLOT_US 9
+// Contention window in slots.
+#define AIR_CW 16
+
+// With -w, rebooted badges count as back in sync from the first ON edge after which every
+// ON edge is this close to one of the badges that kept running, in milliseconds.
+#define REJOIN_WINDOW LP_WINDOW
+
+// Energy model (ESP32 only; the screen and LEDs are the same in both modes).
+// Current with the radio on, in mA.
+#define CURRENT_RADIO 110.0
+// Current awake with the radio off, in mA.
+#define CURRENT_AWAKE 40.0
+// Current in light sleep, in mA.
+#define CURRENT_SLEEP 1.5
+
+typedef struct {
+    sync_t  sync;
+    // Global time at which the badge boots; its clock starts at 0 then.
+    int64_t boot_time;
+    // Local milliseconds per global millisecond.
+    double  rate;
+    // Global time until which the badge is in light sleep.
+    int64_t sleep_until;
+    // Last time of sending ping (local time).
+    int64_t last_ping_time;
+    // Is the radio on during this step?
+    bool    rx;
+    // With -w: global time of the reboot, or -1; whether it was from the saved period.
+    int64_t reboot_time;
+    bool    warm;
+    // Milliseconds spent per power state.
+    int64_t radio_ms, awake_ms, sleep_ms;
+} node_t;
+
+typedef struct {
+    int            from;
+    clock_packet_t packet;
+    size_t         len;
+    // Backoff drawn while contending for the channel, in slots.
+    int            backoff;
+} pending_t;
+
+typedef struct {
+    char const *name;
+    bool        low_power;
+    // One of the PERIOD_MODE_* values.
+    int         period_mode;
+    // One of the ANNOUNCE_MODE_* values.
+    int         announce_mode;
+    bool        clock_mode;
+} sim_mode_t;
+
+// Modes compared; with -c, what the first badge of the first mode hears is captured.
+static sim_mode_t const modes[] = {
+    {"always-on",  false, PERIOD_MODE_CYCLE,  ANNOUNCE_MODE_BACKOFF,   false},
+    {"immediate",  false, PERIOD_MODE_CYCLE,  ANNOUNCE_MODE_IMMEDIATE, false},
+    {"per-packet", false, PERIOD_MODE_PACKET, ANNOUNCE_MODE_BACKOFF,   false},
+    {"low-power",  true,  PERIOD_MODE_CYCLE,  ANNOUNCE_MODE_BACKOFF,   false},
+    {"clock",      false, PERIOD_MODE_CYCLE,  ANNOUNCE_MODE_BACKOFF,   true},
+    {"clock-imm",  false, PERIOD_MODE_CYCLE,  ANNOUNCE_MODE_IMMEDIATE, true},
+};
+
+typedef struct {
+    int      n_nodes;
+    // Run time in milliseconds.
+    int64_t  duration;
+    uint32_t seed;
+    // Probability of hearing a packet in percent.
+    int      heard_percent;
+    // Largest clock error in parts per million.
+    int      drift_ppm;
+    // Whether packets sent at the same time can collide.
+    bool     collisions;
+    // Badges rebooted in the second half, half of them from their saved period.
+    int      rejoin;
+} setup_t;
+
+typedef struct {
+    // Mean time between first and last ON edge of a flash.
+    double flash_spread;
+    // Mean fraction of the swarm taking part in a flash.
+    double flash_group;
+    // Standard deviation of the cycle time across the swarm at the end.
+    double period_stddev;
+    // Fraction of the time the radio was on.
+    double radio_duty;
+    // Average current in mA.
+    double current;
+    // Packets delivered / packets that could have been delivered.
+    double delivery;
+    // Fraction of the packets sent that collided.
+    double collided;
+    // Packets sent per badge per second.
+    double send_rate;
+    // With -w: mean and largest number of ON edges out of sync after a reboot, cold and warm.
+    double rejoin_cold, rejoin_warm;
+    int    rejoin_cold_max, rejoin_warm_max;
+} result_t;
+
+// Local time of `node` at global time `t`.
+static int64_t local_time(node_t const *node, int64_t t) {
+    return (t - node->boot_time) * node->rate;
+}
+
+// Reboots `node` at global time `t`; with `warm`, it starts from the period it would have saved.
+static void reboot(node_t *node, sim_mode_t const *mode, int64_t t, bool warm) {
+    int64_t on  = node->sync.led_on_duration;
+    int64_t off = node->sync.led_off_duration;
+    sync_init(&node->sync, esp_random());
+    node->sync.low_power     = mode->low_power;
+    node->sync.period_mode   = mode->period_mode;
+    node->sync.announce_mode = mode->announce_mode;
+    if (warm) sync_warm_start(&node->sync, on, off);
+    if (mode->clock_mode) sync_set_clock_mode(&node->sync, 0, true);
+    node->boot_time      = t;
+    node->sleep_until    = 0;
+    node->last_ping_time = 0;
+    node->warm           = warm;
+}
+
+// Number of ON edges of rebooted badge `n` before it stayed in sync with the badges that kept
+// running; all of its edges if it never did. `edges` is sorted, `edge_nodes` says whose they are.
+static int rejoin_edges(int64_t const *edges, int const *edge_nodes, size_t edges_len, node_t const *nodes, int n) {
+    int count = 0, out = 0;
+    for (size_t i = 0; i < edges_len; i++) {
+        if (edge_nodes[i] != n || edges[i] < nodes[n].reboot_time) continue;
+        count++;
+        bool in_sync = false;
+        for (size_t j = i; j-- > 0 && edges[i] - edges[j] <= REJOIN_WINDOW && !in_sync;) {
+            in_sync = nodes[edge_nodes[j]].reboot_time < 0;
+        }
+        for (size_t j = i + 1; j < edges_len && edges[j] - edges[i] <= REJOIN_WINDOW && !in_sync; j++) {
+            in_sync = nodes[edge_nodes[j]].reboot_time < 0;
+        }
+        if (!in_sync) out = count;
+    }
+    return out;
+}
+
+// Appends a packet heard by the first badge to the trace.
+static void capture(FILE *fd, int64_t now, pending_t const *pending) {
+    trace_record_t record = {
+        .time = now,
+        .mac  = {0x02, 0x00, 0x00, pending->from >> 16, pending->from >> 8, pending->from},
+        .rssi = TRACE_RSSI_UNKNOWN,
+        .len  = pending->len,
+    };
+    fwrite(&record, sizeof(record), 1, fd);
+    fwrite(&pending->packet, pending->len, 1, fd);
+}
+
+// Appends a packet from badge `from` to the channel queue; the caller fills it in.
+static pending_t *queue_push(pending_t **queue, size_t *len, size_t *cap, int from) {
+    if (*len == *cap) {
+        *cap *= 2;
+        *queue = realloc(*queue, *cap * sizeof(pending_t));
+    }
+    pending_t *packet = &(*queue)[(*len)++];
+    packet->from = from;
+    return packet;
+}
+
+// Lets the `queue_len` packets in `queue` contend for the channel once. Moves the packets that
+// go on air to the end of the queue and returns how many; more than one means they collided.
+// `slot` is set to the backoff they waited, in slots.
+static size_t contend(pending_t *queue, size_t queue_len, int *slot) {
+    // Every round, each sender draws a new backoff.
+    int best = AIR_CW;
+    for (size_t q = 0; q < queue_len; q++) {
+        queue[q].backoff = esp_random() % AIR_CW;
+        if (queue[q].backoff < best) best = queue[q].backoff;
+    }
+    size_t winners = 0;
+    for (size_t q = 0; q < queue_len - winners;) {
+        if (queue[q].backoff == best) {
+            winners++;
+            pending_t tmp = queue[q];
+            queue[q] = queue[queue_len - winners];
+            queue[queue_len - winners] = tmp;
+        } else {
+            q++;
+        }
+    }
+    *slot = best;
+    return winners;
+}
+
+// Runs one simulation of `mode`; if `trace` is not NULL, what the first badge hears is captured to it.
+static result_t simulate(setup_t const *setup, sim_mode_t const *mode, FILE *trace) {
+    int     n_nodes       = setup->n_nodes;
+    int64_t duration      = setup->duration;
+    int     heard_percent = setup->heard_percent;
+    host_seed(setup->seed);
+    node_t    *nodes   = calloc(n_nodes, sizeof(node_t));
+    size_t     queue_cap = n_nodes * 2, queue_len = 0;
+    pending_t *queue   = malloc(queue_cap * sizeof(pending_t));
+    size_t     edges_cap = 1024, edges_len = 0;
+    int64_t   *edges   = malloc(edges_cap * sizeof(int64_t));
+    int       *edge_nodes = malloc(edges_cap * sizeof(int));
+    int64_t    measure_from = duration / 2;
+    int64_t    delivered = 0, deliverable = 0;
+    int64_t    sent = 0, collided = 0;
+    // Airtime left in this millisecond, in microseconds; negative while a packet spills into it.
+    int64_t    air_us = 0;
+
+    for (int i = 0; i < n_nodes; i++) {
+        sync_init(&nodes[i].sync, esp_random());
+        nodes[i].sync.low_power     = mode->low_power;
+        nodes[i].sync.period_mode   = mode->period_mode;
+        nodes[i].sync.announce_mode = mode->announce_mode;
+        nodes[i].boot_time      = esp_random() % BOOT_SPREAD;
+        nodes[i].rate           = 1 + ((int) (esp_random() % (2 * setup->drift_ppm + 1)) - setup->drift_ppm) * 1e-6;
+        if (mode->clock_mode) sync_set_clock_mode(&nodes[i].sync, 0, true);
+        nodes[i].reboot_time    = i < setup->rejoin ? measure_from + esp_random() % BOOT_SPREAD : -1;
+    }
+    if (trace) {
+        trace_header_t header = {
+            .magic   = TRACE_MAGIC,
+            .version = TRACE_VERSION,
+            .randid  = nodes[0].sync.randid,
+        };
+        fwrite(&header, sizeof(header), 1, trace);
+    }
+
+    for (int64_t t = 0; t < duration; t++) {
+        for (int i = 0; i < n_nodes; i++) {
+            node_t *node = &nodes[i];
+            node->rx = false;
+            if (t == node->reboot_time) reboot(node, mode, t, i % 2);
+            if (t < node->boot_time) continue;
+            if (t < node->sleep_until) {
+                node->sleep_ms++;
+                continue;
+            }
+            int64_t now = local_time(node, t);
+
+            node->rx = sync_radio_needed(&node->sync, now);
+            if (node->rx) {
+                node->radio_ms++;
+            } else {
+                node->awake_ms++;
+            }
+
+            if (node->rx && now > node->last_ping_time + PING_INTERVAL) {
+                pending_t *packet = queue_push(&queue, &queue_len, &queue_cap, i);
+                packet->len = sync_make_clock_packet(&node->sync, now, &packet->packet, 0);
+                node->last_ping_time = now;
+            }
+
+            int      edge     = sync_tick(&node->sync, now);
+            uint32_t announce = sync_announce(&node->sync, now);
+            if (announce && node->rx) {
+                pending_t *packet = queue_push(&queue, &queue_len, &queue_cap, i);
+                packet->len = sync_make_clock_packet(&node->sync, now, &packet->packet, announce);
+            }
+            if (edge == SYNC_EDGE_ON && t >= measure_from) {
+                if (edges_len == edges_cap) {
+                    edges_cap *= 2;
+                    edges      = realloc(edges, edges_cap * sizeof(int64_t));
+                    edge_nodes = realloc(edge_nodes, edges_cap * sizeof(int));
+                }
+                edge_nodes[edges_len] = i;
+                edges[edges_len++]    = t;
+            }
+
+            if (!node->rx && !node->sync.led_state) {
+                int64_t wake = sync_next_wake(&node->sync, now);
+                if (wake - now >= LP_MIN_SLEEP) {
+                    node->sleep_until = t + wake - now;
+                }
+            }
+        }
+
+        // Put as much on air during this step as fits; the rest waits in the queue.
+        air_us += 1000;
+        if (air_us > 1000) air_us = 1000;
+        while (queue_len && (air_us > 0 || !setup->collisions)) {
+            int    slot    = 0;
+            size_t winners = setup->collisions ? contend(queue, queue_len, &slot) : queue_len;
+            air_us -= slot * AIR_SLOT_US + AIR_PACKET_US;
+            for (size_t p = queue_len - winners; p < queue_len; p++) {
+                sent++;
+                collided += winners > 1 && setup->collisions;
+                for (int i = 0; i < n_nodes; i++) {
+                    if (i == queue[p].from || t < nodes[i].boot_time) continue;
+                    deliverable++;
+                    if (winners > 1 && setup->collisions) continue;
+                    if (!nodes[i].rx || (int) (esp_random() % 100) >= heard_percent) continue;
+                    delivered++;
+                    int64_t now = local_time(&nodes[i], t);
+                    if (trace && i == 0) capture(trace, now, &queue[p]);
+                    sync_recv(&nodes[i].sync, now, (uint8_t const *) &queue[p].packet, queue[p].len);
+                }
+            }
+            queue_len -= winners;
+        }
+    }
+
+    result_t res = {0};
+
+    // Edges are recorded in time order, so they are sorted already.
+    int n_cold = 0, n_warm = 0;
+    for (int i = 0; i < setup->rejoin; i++) {
+        int out = rejoin_edges(edges, edge_nodes, edges_len, nodes, i);
+        if (nodes[i].warm) {
+            res.rejoin_warm += out;
+            if (out > res.rejoin_warm_max) res.rejoin_warm_max = out;
+            n_warm++;
+        } else {
+            res.rejoin_cold += out;
+            if (out > res.rejoin_cold_max) res.rejoin_cold_max = out;
+            n_cold++;
+        }
+    }
+    if (n_cold) res.rejoin_cold /= n_cold;
+    if (n_warm) res.rejoin_warm /= n_warm;
+
+    // Group ON edges into flashes.
+    size_t n_flashes = 0;
+    for (size_t i = 0; i < edges_len;) {
+        size_t j = i + 1;
+        while (j < edges_len && edges[j] - edges[j - 1] < FLASH_GAP) j++;
+        res.flash_spread += edges[j - 1] - edges[i];
+        res.flash_group  += (double) (j - i) / n_nodes;
+        n_flashes++;
+        i = j;
+    }
+    if (n_flashes) {
+        res.flash_spread /= n_flashes;
+        res.flash_group  /= n_flashes;
+    }
+
+    // Period spread and energy.
+    double  mean = 0, var = 0;
+    int64_t radio = 0, awake = 0, sleep = 0;
+    for (int i = 0; i < n_nodes; i++) {
+        mean  += nodes[i].sync.led_on_duration + nodes[i].sync.led_off_duration;
+        radio += nodes[i].radio_ms;
+        awake += nodes[i].awake_ms;
+        sleep += nodes[i].sleep_ms;
+    }
+    mean /= n_nodes;
+    for (int i = 0; i < n_nodes; i++) {
+        double d = nodes[i].sync.led_on_duration + nodes[i].sync.led_off_duration - mean;
+        var += d * d;
+    }
+    res.period_stddev = sqrt(var / n_nodes);
+    int64_t total    = radio + awake + sleep;
+    res.radio_duty   = total ? (double) radio / total : 0;
+    res.current      = total ? (radio * CURRENT_RADIO + awake * CURRENT_AWAKE + sleep * CURRENT_SLEEP) / total : 0;
+    res.delivery     = deliverable ? (double) delivered / deliverable : 0;
+    res.collided     = sent ? (double) collided / sent : 0;
+    res.send_rate    = (double) sent / n_nodes / (duration / 1000.0);
+
+    free(edges);
+    free(edge_nodes);
+    free(queue);
+    free(nodes);
+    return res;
+}
+
+static void print_result(char const *name, result_t res) {
+    printf("%-10s %9.0f ms %9.1f %% %9.1f ms %9.1f %% %9.1f mA %9.1f %% %9.1f %% %8.2f/s\n",
+        name, res.flash_spread, res.flash_group * 100, res.period_stddev,
+        res.radio_duty * 100, res.current, res.delivery * 100, res.collided * 100, res.send_rate);
+}
+
+int main(int argc, char **argv) {
+    setup_t setup = {
+        .n_nodes       = 20,
+        .duration      = 300,
+        .seed          = 1,
+        .heard_percent = PACKET_HEARD_PERCENT,
+        .drift_ppm     = CLOCK_DRIFT_PPM,
+        .collisions    = true,
+    };
+    FILE *trace = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:s:p:d:iw:c:")) != -1) {
+        switch (opt) {
+            case 'n': setup.n_nodes       = atoi(optarg); break;
+            case 't': setup.duration      = atoll(optarg); break;
+            case 's': setup.seed          = strtoul(optarg, NULL, 0); break;
+            case 'p': setup.heard_percent = atoi(optarg); break;
+            case 'd': setup.drift_ppm     = atoi(optarg); break;
+            case 'i': setup.collisions    = false; break;
+            case 'w': setup.rejoin        = atoi(optarg); break;
+            case 'c':
+                trace = fopen(optarg, "wb");
+                if (!trace) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n nodes] [-t seconds] [-s seed] [-p heard_percent] [-d drift_ppm] [-i] [-w rebooted] [-c capture.bin]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (setup.n_nodes < 2 || setup.duration < 1 || setup.drift_ppm < 0 || setup.rejoin < 0 || setup.rejoin >= setup.n_nodes) {
+        fprintf(stderr, "Need at least 2 nodes and 1 second, and fewer rebooted badges than nodes\n");
+        return 1;
+    }
+
+    printf("%d nodes, %lld s, seed %u, %d%% of packets heard, clocks within %d ppm, %s\n", setup.n_nodes,
+        (long long) setup.duration, setup.seed, setup.heard_percent, setup.drift_ppm,
+        setup.collisions ? "packets can collide" : "ideal channel");
+    printf("Statistics over the second half of the run.\n");
+    if (setup.rejoin) printf("%d badges reboot soon after half time, every other one from its saved period.\n", setup.rejoin);
+    printf("\n");
+    printf("%-10s %12s %11s %12s %11s %12s %11s %11s %10s\n", "mode", "flash spread", "flash group", "period stdev",
+        "radio duty", "avg current", "delivery", "collided", "sent");
+    setup.duration *= 1000;
+    result_t results[sizeof(modes) / sizeof(modes[0])];
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        results[i] = simulate(&setup, &modes[i], i == 0 ? trace : NULL);
+        print_result(modes[i].name, results[i]);
+    }
+    if (trace) fclose(trace);
+
+    if (setup.rejoin) {
+        printf("\nBlinks out of sync after the reboot, mean and worst:\n\n");
+        printf("%-10s %15s %15s\n", "mode", "cold start", "warm start");
+        for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+            printf("%-10s %9.1f %5d %9.1f %5d\n", modes[i].name, results[i].rejoin_cold, results[i].rejoin_cold_max,
+                results[i].rejoin_warm, results[i].rejoin_warm_max);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Receive flood benchmark.
+// Runs one badge among well-behaved peers while another sender floods it with
+// 10000 packets per second, with and without the receive filter, and reports
+// what the flood costs per packet and how far it drags the badge's period.
+
+#include "esp_system.h"
+#include "firefly_sync.h"
+#include "rx_filter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Flood packets per millisecond.
+#define FLOOD_PER_MS  10
+// Period of the well-behaved peers.
+#define PEER_PERIOD   4000
+// Time the flood starts, after the badge has heard all peers, in milliseconds.
+#define FLOOD_START   10000
+
+// Kinds of flood.
+typedef enum {
+    FLOOD_NONE,
+    // Packets that are not firefly packets.
+    FLOOD_GARBAGE,
+    // Valid packets from one MAC address and randid.
+    FLOOD_SINGLE,
+    // Valid packets from a new MAC address every time, with one randid.
+    FLOOD_ROTATE_MAC,
+    // Valid packets with a new MAC address and randid every time.
+    FLOOD_ROTATE_ALL,
+    FLOOD_KINDS,
+} flood_t;
+
+static char const *const flood_names[FLOOD_KINDS] = {
+    "none", "garbage", "single", "rotate mac", "rotate all",
+};
+
+typedef struct {
+    // Final period of the badge.
+    int64_t  period;
+    // Flood packets given to the sync logic.
+    uint64_t flood_accepted;
+    // Peer packets given to the sync logic during the flood.
+    uint64_t peer_accepted;
+    // Peer packets sent during the flood.
+    uint64_t peer_sent;
+    // CPU time per flood packet in nanoseconds.
+    double   flood_ns;
+} result_t;
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Receives a packet like espnow_recv, optionally through the filter; returns true if the sync logic saw it.
+static bool receive(sync_t *sync, rx_filter_t *filter, int64_t now, uint8_t const *mac, packet_t const *packet, size_t len) {
+    if (filter && rx_filter_check(filter, now, mac, (uint8_t const *) packet, len) != RX_ACCEPT) return false;
+    return sync_recv(sync, now, (uint8_t const *) packet, len);
+}
+
+static result_t simulate(flood_t flood, bool filtered, int peers, int64_t duration, uint32_t seed) {
+    host_seed(seed);
+    sync_t      *sync   = malloc(sizeof(sync_t));
+    rx_filter_t *filter = filtered ? malloc(sizeof(rx_filter_t)) : NULL;
+    sync_init(sync, esp_random());
+    sync_warm_start(sync, 1000, PEER_PERIOD - 1000);
+    if (filter) rx_filter_init(filter, 0);
+
+    result_t res = {0};
+    double   flood_time = 0;
+    uint32_t counter    = 0;
+    for (int64_t now = 0; now < duration; now++) {
+        sync_tick(sync, now);
+
+        // Peers ping every second and send ON and OFF once per period, at their own phase.
+        for (int i = 0; i < peers; i++) {
+            int64_t  phase = (now + i * 97) % PEER_PERIOD;
+            uint32_t flags;
+            if (phase == 0) {
+                flags = PACKET_FLAG_LED_ON;
+            } else if (phase == 1000) {
+                flags = PACKET_FLAG_LED_OFF;
+            } else if (phase % PING_INTERVAL == 500) {
+                flags = 0;
+            } else {
+                continue;
+            }
+            packet_t packet;
+            memcpy(packet.magic, packet_magic, sizeof(packet_magic));
+            packet.flags          = flags;
+            packet.total_duration = PEER_PERIOD;
+            packet.randid         = 0x1000 + i;
+            uint8_t mac[6]        = {0x02, 0, 0, 0, 0x10, i};
+            bool accepted = receive(sync, filter, now, mac, &packet, sizeof(packet));
+            if (now >= FLOOD_START) {
+                res.peer_sent++;
+                res.peer_accepted += accepted;
+            }
+        }
+
+        if (flood == FLOOD_NONE || now < FLOOD_START) continue;
+        // The flood advertises the longest period to drag the badge along.
+        double start = now_ns();
+        for (int i = 0; i < FLOOD_PER_MS; i++) {
+            counter++;
+            packet_t packet;
+            memcpy(packet.magic, packet_magic, sizeof(packet_magic));
+            if (flood == FLOOD_GARBAGE) packet.magic[0] ^= 1 + counter % 255;
+            packet.flags          = counter % 4 ? 0 : PACKET_FLAG_LED_ON;
+            packet.total_duration = LED_ON_DURATION_MAX + LED_OFF_DURATION_MAX;
+            packet.randid         = flood == FLOOD_ROTATE_ALL ? counter * 2654435761u : 0xbad;
+            uint8_t mac[6]        = {0x06, 0, 0, 0, 0, 0};
+            if (flood == FLOOD_ROTATE_MAC || flood == FLOOD_ROTATE_ALL) memcpy(mac + 2, &counter, 4);
+            res.flood_accepted += receive(sync, filter, now, mac, &packet, sizeof(packet));
+        }
+        flood_time += now_ns() - start;
+    }
+
+    res.period   = sync->led_on_duration + sync->led_off_duration;
+    res.flood_ns = flood == FLOOD_NONE ? 0 : flood_time / ((duration - FLOOD_START) * FLOOD_PER_MS);
+    free(filter);
+    free(sync);
+    return res;
+}
+
+static void print_result(char const *name, bool filtered, result_t res) {
+    printf("%-11s %-9s %8lld ms %10llu %9.1f %% %9.0f ns\n", name, filtered ? "filter" : "none",
+        (long long) res.period, (unsigned long long) res.flood_accepted,
+        res.peer_sent ? 100.0 * res.peer_accepted / res.peer_sent : 0, res.flood_ns);
+}
+
+int main(int argc, char **argv) {
+    int      peers    = argc > 1 ? atoi(argv[1]) : 20;
+    int64_t  duration = (argc > 2 ? atoi(argv[2]) : 60) * 1000LL;
+    if (duration <= FLOOD_START) duration = FLOOD_START + 1000;
+    uint32_t seed     = 1;
+
+    printf("%d peers with a %d ms period, %d flood packets per second from %d s to %lld s:\n\n", peers, PEER_PERIOD,
+        FLOOD_PER_MS * 1000, FLOOD_START / 1000, (long long) duration / 1000);
+    printf("%-11s %-9s %11s %10s %11s %12s\n", "flood", "rx filter", "period", "flood in", "peers in", "per packet");
+    for (int flood = 0; flood < FLOOD_KINDS; flood++) {
+        print_result(flood_names[flood], false, simulate(flood, false, peers, duration, seed));
+        print_result(flood_names[flood], true, simulate(flood, true, peers, duration, seed));
+    }
+    return 0;
+}
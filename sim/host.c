@@ -0,0 +1,26 @@
+// Host implementations of the ESP-IDF functions used by the portable sources.
+
+#include "esp_system.h"
+#include "i2c_sched.h"
+
+static uint32_t host_rng_state = 0x2545f491;
+
+// Seed the PRNG behind esp_random.
+void host_seed(uint32_t seed) {
+    host_rng_state = seed ? seed : 0x2545f491;
+}
+
+// Xorshift32; plenty for simulation.
+uint32_t esp_random() {
+    uint32_t x = host_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    host_rng_state = x;
+    return x;
+}
+
+// There is no bus to share on the host; jobs run right away.
+esp_err_t i2c_sched_run(int prio, i2c_job_fn_t fn, void *arg) {
+    return fn(arg);
+}
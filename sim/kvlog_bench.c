@@ -0,0 +1,94 @@
+// Warm-start log benchmark.
+// Saves the warm-start state many times into the simulated SAO storage region,
+// checks it reads back after every save, and reports write amplification and
+// page wear compared to rewriting one fixed record in place.
+
+#include "eeprom_mock.h"
+#include "kvlog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Storage region of the firefly SAO: from page 1 to the end of the EEPROM.
+#define REGION_START MOCK_EEPROM_PAGE_SIZE
+#define REGION_SIZE  (MOCK_EEPROM_SIZE - MOCK_EEPROM_PAGE_SIZE)
+// Keys saved, like warm_start.c: on time and off time.
+#define NUM_KEYS     2
+// Useful bytes per save.
+#define PAYLOAD      (NUM_KEYS * 4)
+
+static uint32_t max_wear() {
+    uint32_t max = 0;
+    for (size_t i = 0; i < MOCK_EEPROM_SIZE / MOCK_EEPROM_PAGE_SIZE; i++) {
+        if (mock_eeprom_wear[i] > max) max = mock_eeprom_wear[i];
+    }
+    return max;
+}
+
+static void report(char const *name, int saves) {
+    printf("%-12s %8.2f %8.1f %8.1f %10u %10.1f ms\n", name,
+        (double) mock_eeprom_stats.page_writes / saves,
+        (double) mock_eeprom_stats.bytes_written / saves,
+        (double) mock_eeprom_stats.page_writes * MOCK_EEPROM_PAGE_SIZE / saves / PAYLOAD,
+        max_wear(),
+        mock_eeprom_stats.bus_us / saves / 1000);
+}
+
+int main(int argc, char **argv) {
+    int saves = argc > 1 ? atoi(argv[1]) : 10000;
+    if (saves < 1) saves = 1;
+    EEPROM eeprom = {.i2c_bus = 0, .i2c_address = 0x50, .address_16bit = true, .page_size = MOCK_EEPROM_PAGE_SIZE};
+
+    printf("%d saves of %d bytes, %d byte pages, per save:\n\n", saves, PAYLOAD, MOCK_EEPROM_PAGE_SIZE);
+    printf("%-12s %8s %8s %8s %10s %13s\n", "layout", "pages", "bytes", "amplif.", "max wear", "write time");
+
+    // Rewriting one fixed record in place.
+    mock_eeprom_erase();
+    for (int i = 0; i < saves; i++) {
+        int32_t values[NUM_KEYS] = {1000 + i % 250, 3000 + i % 1000};
+        eeprom_write(&eeprom, REGION_START, (uint8_t *) values, sizeof(values));
+    }
+    report("in place", saves);
+
+    // The key-value log.
+    mock_eeprom_erase();
+    kvlog_t log;
+    if (kvlog_open(&log, &eeprom, REGION_START, REGION_SIZE)) {
+        fprintf(stderr, "Open failed\n");
+        return 1;
+    }
+    memset(&mock_eeprom_stats, 0, sizeof(mock_eeprom_stats));
+    for (int i = 0; i < saves; i++) {
+        int32_t values[NUM_KEYS] = {1000 + i % 250, 3000 + i % 1000};
+        for (int key = 0; key < NUM_KEYS; key++) {
+            kvlog_set(&log, key, &values[key], sizeof(int32_t));
+        }
+        if (kvlog_commit(&log)) {
+            fprintf(stderr, "Commit %d failed\n", i);
+            return 1;
+        }
+    }
+    mock_eeprom_stats_t stats = mock_eeprom_stats;
+    report("kvlog", saves);
+
+    // Reopening must find the last save.
+    kvlog_t reopened;
+    kvlog_open(&reopened, &eeprom, REGION_START, REGION_SIZE);
+    for (int key = 0; key < NUM_KEYS; key++) {
+        int32_t expected = key == 0 ? 1000 + (saves - 1) % 250 : 3000 + (saves - 1) % 1000;
+        int32_t value;
+        if (!kvlog_get(&reopened, key, &value, sizeof(value)) || value != expected) {
+            fprintf(stderr, "Key %d reads back wrong\n", key);
+            return 1;
+        }
+    }
+    if (reopened.next != log.next || reopened.seq != log.seq) {
+        fprintf(stderr, "Reopened log resumes at the wrong position\n");
+        return 1;
+    }
+    printf("\nReopening reads %u bytes in %u transactions (%.1f ms) and finds the last save.\n",
+        mock_eeprom_stats.bytes_read - stats.bytes_read, mock_eeprom_stats.reads - stats.reads,
+        (mock_eeprom_stats.bus_us - stats.bus_us) / 1000);
+    return 0;
+}
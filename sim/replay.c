@@ -0,0 +1,154 @@
+// Packet trace replay.
+// Feeds a trace captured on a badge (see main/include/trace.h) through the sync logic
+// as fast as possible, and reports what the badge would have done and how fast it ran.
+
+#include "esp_system.h"
+#include "firefly_sync.h"
+#include "rx_filter.h"
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    // Records replayed.
+    uint64_t records;
+    // Records rejected by the receive filter, per RX_* verdict.
+    uint64_t rejected[RX_VERDICTS];
+    // LED ON edges.
+    uint64_t edges;
+    // Most peers seen at once.
+    size_t   max_peers;
+    // Simulated milliseconds.
+    int64_t  duration;
+    // Cycle time at the end.
+    int64_t  total_duration;
+} replay_t;
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Replays the records in `data` once.
+static bool replay(uint8_t const *data, size_t size, uint32_t seed, sync_t *sync, rx_filter_t *filter, replay_t *out) {
+    trace_header_t header;
+    memcpy(&header, data, sizeof(header));
+    host_seed(seed);
+    sync_init(sync, header.randid);
+    memset(out, 0, sizeof(replay_t));
+
+    size_t  pos   = sizeof(trace_header_t);
+    int64_t now   = -1;
+    int64_t start = 0;
+    while (pos + sizeof(trace_record_t) <= size) {
+        trace_record_t record;
+        memcpy(&record, data + pos, sizeof(record));
+        pos += sizeof(record);
+        if (pos + record.len > size) {
+            fprintf(stderr, "Truncated record at offset %zu\n", pos - sizeof(record));
+            return false;
+        }
+
+        // Run the badge up to the receive time, one millisecond at a time like the main loop.
+        if (now < 0) {
+            now   = record.time;
+            start = now;
+            rx_filter_init(filter, now);
+        }
+        for (; now < (int64_t) record.time; now++) {
+            if (sync_tick(sync, now) == SYNC_EDGE_ON) {
+                out->edges++;
+                size_t peers = sync_count_peers(sync, now);
+                if (peers > out->max_peers) out->max_peers = peers;
+            }
+        }
+
+        // Through the same filter as espnow_recv.
+        int verdict = rx_filter_check(filter, now, record.mac, data + pos, record.len);
+        if (verdict == RX_ACCEPT) {
+            sync_recv(sync, now, data + pos, record.len);
+        } else {
+            out->rejected[verdict]++;
+        }
+        out->records++;
+        pos += record.len;
+    }
+
+    out->duration       = now - start;
+    out->total_duration = sync->led_on_duration + sync->led_off_duration;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int      repeat = 1;
+    uint32_t seed   = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+        switch (opt) {
+            case 'r': repeat = atoi(optarg); break;
+            case 's': seed   = strtoul(optarg, NULL, 0); break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc - 1 || repeat < 1) goto usage;
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if ((size_t) st.st_size < sizeof(trace_header_t)) {
+        fprintf(stderr, "%s: too short for a trace\n", argv[optind]);
+        return 1;
+    }
+    uint8_t const *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    trace_header_t header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) || header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d trace\n", argv[optind], TRACE_VERSION);
+        return 1;
+    }
+
+    sync_t      *sync   = malloc(sizeof(sync_t));
+    rx_filter_t *filter = malloc(sizeof(rx_filter_t));
+    replay_t res;
+    double   start = now_s();
+    for (int i = 0; i < repeat; i++) {
+        if (!replay(data, st.st_size, seed, sync, filter, &res)) return 1;
+    }
+    double elapsed = (now_s() - start) / repeat;
+
+    printf("Trace of badge %08x: %llu records over %.1f s\n", header.randid, (unsigned long long) res.records, res.duration / 1000.0);
+    printf("  rejected:      %llu short, %llu invalid, %llu sender rate, %llu swarm rate\n",
+        (unsigned long long) res.rejected[RX_REJECT_SHORT], (unsigned long long) res.rejected[RX_REJECT_MAGIC],
+        (unsigned long long) res.rejected[RX_REJECT_SENDER], (unsigned long long) res.rejected[RX_REJECT_SWARM]);
+    printf("  blinks:        %llu\n", (unsigned long long) res.edges);
+    printf("  max peers:     %zu\n", res.max_peers);
+    printf("  final period:  %lld ms\n", (long long) res.total_duration);
+    printf("  replay time:   %.3f ms (%.0fx real time, %.0f ns per record)\n", elapsed * 1000,
+        elapsed > 0 ? res.duration / 1000.0 / elapsed : 0, res.records ? elapsed * 1e9 / res.records : 0);
+
+    free(filter);
+    free(sync);
+    munmap((void *) data, st.st_size);
+    close(fd);
+    return 0;
+
+usage:
+    fprintf(stderr, "Usage: %s [-r repeat] [-s seed] trace.bin\n", argv[0]);
+    return 1;
+}
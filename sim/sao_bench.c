@@ -0,0 +1,88 @@
+// SAO descriptor benchmark.
+// Parses the firefly SAO descriptor from the simulated EEPROM in both the binary
+// "LIFE" format and the JSON format, and reports CPU time and I2C traffic.
+
+#include "eeprom_mock.h"
+#include "sao_eeprom.h"
+#include "sao_json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The firefly SAO descriptor (see sao_rom.txt) in JSON form.
+static char const firefly_json[] =
+    "JSON{\"name\": \"Firefly friend\", \"drivers\": [\n"
+    "    {\"name\": \"storage\", \"data\": [0, 80, 14, 6, 1, 0]},\n"
+    "    {\"name\": \"app\",     \"data\": \"firefly\"},\n"
+    "    {\"name\": \"firefly\", \"data\": [1, 1, 57, 5]}\n"
+    "]}";
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Builds the binary firefly descriptor with the regular formatting code.
+static void load_binary() {
+    sao_driver_t drivers[3] = {
+        {.name = SAO_DRIVER_STORAGE_NAME, .data = {0x00, 0x50, 0x0e, 0x06, 0x01, 0x00}, .data_length = 6},
+        {.name = SAO_DRIVER_APP_NAME,     .data = "firefly",                            .data_length = 8},
+        {.name = SAO_DRIVER_FIREFLY_NAME, .data = {0x01, 0x01, 57, 5},                  .data_length = 4},
+    };
+    uint8_t *buf;
+    size_t   len;
+    if (sao_format_data("Firefly friend", MOCK_EEPROM_SIZE, MOCK_EEPROM_PAGE_SIZE, drivers, 3, false, &buf, &len)) {
+        fprintf(stderr, "Formatting failed\n");
+        exit(1);
+    }
+    mock_eeprom_erase();
+    memcpy(mock_eeprom, buf, len);
+    free(buf);
+}
+
+static void load_json() {
+    mock_eeprom_erase();
+    memcpy(mock_eeprom, firefly_json, sizeof(firefly_json));
+}
+
+// Identifies the SAO `iterations` times and prints the averages.
+static void bench(char const *name, int iterations) {
+    SAO sao;
+    memset(&mock_eeprom_stats, 0, sizeof(mock_eeprom_stats));
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        if (sao_identify(&sao)) {
+            fprintf(stderr, "%s: identify failed\n", name);
+            exit(1);
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    sao_driver_t const *firefly = sao.by_type[SAO_DRIVER_FIREFLY];
+    if (!firefly || firefly->firefly.serial_no_lo + firefly->firefly.serial_no_hi * 256 != 1337
+        || !sao.by_type[SAO_DRIVER_STORAGE] || !sao.by_type[SAO_DRIVER_APP] || strcmp(sao.name, "Firefly friend")) {
+        fprintf(stderr, "%s: descriptor parsed incorrectly\n", name);
+        exit(1);
+    }
+
+    printf("%-8s %10.0f ns %10.1f %10.1f %10.1f us\n", name, elapsed / iterations,
+        (double) mock_eeprom_stats.reads / iterations,
+        (double) mock_eeprom_stats.bytes_read / iterations,
+        mock_eeprom_stats.bus_us / iterations);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    if (iterations < 1) iterations = 1;
+
+    printf("%d iterations of sao_identify, per iteration:\n\n", iterations);
+    printf("%-8s %13s %10s %10s %13s\n", "format", "cpu", "i2c reads", "bytes", "i2c time");
+    load_binary();
+    bench("binary", iterations);
+    load_json();
+    bench("json", iterations);
+    return 0;
+}
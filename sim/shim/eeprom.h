@@ -0,0 +1,15 @@
+// Host stand-in for the eeprom component, backed by eeprom_mock.c.
+
+#pragma once
+
+#include "esp_system.h"
+
+typedef struct EEPROM {
+    int      i2c_bus;
+    int      i2c_address;
+    bool     address_16bit;
+    uint16_t page_size;
+} EEPROM;
+
+esp_err_t eeprom_read(EEPROM* device, uint16_t address, uint8_t* buffer, size_t length);
+esp_err_t eeprom_write(EEPROM* device, uint16_t address, uint8_t* buffer, size_t length);
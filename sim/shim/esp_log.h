@@ -0,0 +1,9 @@
+// Host stand-in for esp_log.h; logging is compiled out in the simulator.
+
+#pragma once
+
+#define ESP_LOGE(tag, ...) do { (void) (tag); } while (0)
+#define ESP_LOGW(tag, ...) do { (void) (tag); } while (0)
+#define ESP_LOGI(tag, ...) do { (void) (tag); } while (0)
+#define ESP_LOGD(tag, ...) do { (void) (tag); } while (0)
+#define ESP_LOGV(tag, ...) do { (void) (tag); } while (0)
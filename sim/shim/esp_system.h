@@ -0,0 +1,23 @@
+// Host stand-in for the parts of esp_system.h used by the portable sources.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                0
+#define ESP_FAIL              -1
+#define ESP_ERR_NO_MEM        0x101
+#define ESP_ERR_INVALID_ARG   0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE  0x104
+#define ESP_ERR_NOT_FOUND     0x105
+
+// Implemented by host.c with a seedable PRNG.
+uint32_t esp_random();
+// Seed the PRNG behind esp_random.
+void host_seed(uint32_t seed);
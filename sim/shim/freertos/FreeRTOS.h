@@ -0,0 +1,3 @@
+// Host stand-in; the portable sources include this but use nothing from it.
+
+#pragma once
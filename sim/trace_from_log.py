@@ -0,0 +1,24 @@
+#!/usr/bin/env python3
+# Extracts a packet trace streamed over the serial console (TRACE_TO_SERIAL)
+# from a monitor log, and writes it as a binary trace for replay.
+
+import sys
+
+PREFIX = "@FFTR "
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: {} monitor.log trace.bin".format(sys.argv[0]))
+        sys.exit(1)
+    data = bytearray()
+    with open(sys.argv[1], "r", errors="replace") as log:
+        for line in log:
+            pos = line.find(PREFIX)
+            if pos >= 0:
+                data += bytes.fromhex(line[pos + len(PREFIX):].strip())
+    with open(sys.argv[2], "wb") as out:
+        out.write(data)
+    print("Wrote {} bytes".format(len(data)))
+
+if __name__ == "__main__":
+    main()